@@ -3,3 +3,16 @@ function(cxx_test name libs)
 	target_link_libraries("${name}" "${libs}" -lpthread)
 	add_test("${name}" "${name}")
 endfunction()
+
+# Builds one benchmark program from all the given sources, and a
+# "${name}_json" target that runs it and writes ${name}.json.
+function(cxx_bench name srcs libs)
+	add_executable("${name}" ${srcs})
+	target_link_libraries("${name}" "${libs}" -lpthread)
+	add_custom_target("${name}_json"
+		COMMAND "${name}" "--benchmark_out=${CMAKE_BINARY_DIR}/${name}.json"
+			"--benchmark_out_format=json"
+		DEPENDS "${name}"
+		WORKING_DIRECTORY "${CMAKE_BINARY_DIR}"
+		COMMENT "Writing ${CMAKE_BINARY_DIR}/${name}.json")
+endfunction()
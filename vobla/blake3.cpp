@@ -0,0 +1,312 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file blake3.cpp
+ * \brief The BLAKE3 hash (unkeyed, 32-byte output), following the reference
+ * implementation, plus a mode that hashes subtrees on a ThreadPool.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "vobla/hash.h"
+#include "vobla/hash_internal.h"
+#include "vobla/thread_pool.h"
+
+namespace vobla {
+namespace hash_internal {
+
+namespace {
+
+const size_t kBlockLen = 64;
+const size_t kChunkLen = 1024;
+
+/// The number of chunks in the subtrees hashed by one pool task, 512 KB.
+const uint64_t kSubtreeChunks = 512;
+const size_t kSubtreeLen = kSubtreeChunks * kChunkLen;
+
+// Domain separation flags.
+const uint32_t kChunkStart = 1;
+const uint32_t kChunkEnd = 2;
+const uint32_t kParent = 4;
+const uint32_t kRoot = 8;
+
+const uint8_t kMsgPermutation[16] = {
+  2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8,
+};
+
+inline uint32_t Rotr(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t LoadLittleEndian32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+      (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void G(uint32_t* v, int a, int b, int c, int d, uint32_t mx,
+              uint32_t my) {
+  v[a] = v[a] + v[b] + mx;
+  v[d] = Rotr(v[d] ^ v[a], 16);
+  v[c] = v[c] + v[d];
+  v[b] = Rotr(v[b] ^ v[c], 12);
+  v[a] = v[a] + v[b] + my;
+  v[d] = Rotr(v[d] ^ v[a], 8);
+  v[c] = v[c] + v[d];
+  v[b] = Rotr(v[b] ^ v[c], 7);
+}
+
+/**
+ * Compresses one block and writes the first 8 words of the output, which
+ * are all an unkeyed 32-byte hash ever needs.
+ */
+void Compress(const uint32_t cv[8], const uint8_t block[kBlockLen],
+              uint8_t block_len, uint64_t counter, uint32_t flags,
+              uint32_t out[8]) {
+  uint32_t m[16];
+  for (int i = 0; i < 16; i++) {
+    m[i] = LoadLittleEndian32(block + 4 * i);
+  }
+  uint32_t v[16] = {
+    cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+    kSHA256IV[0], kSHA256IV[1], kSHA256IV[2], kSHA256IV[3],
+    static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32),
+    block_len, flags,
+  };
+  // Fully unrolled, the permutations become register renames.
+#pragma GCC unroll 7
+  for (int round = 0; round < 7; round++) {
+    G(v, 0, 4, 8, 12, m[0], m[1]);
+    G(v, 1, 5, 9, 13, m[2], m[3]);
+    G(v, 2, 6, 10, 14, m[4], m[5]);
+    G(v, 3, 7, 11, 15, m[6], m[7]);
+    G(v, 0, 5, 10, 15, m[8], m[9]);
+    G(v, 1, 6, 11, 12, m[10], m[11]);
+    G(v, 2, 7, 8, 13, m[12], m[13]);
+    G(v, 3, 4, 9, 14, m[14], m[15]);
+    uint32_t permuted[16];
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; i++) {
+      permuted[i] = m[kMsgPermutation[i]];
+    }
+    memcpy(m, permuted, sizeof(m));
+  }
+  for (int i = 0; i < 8; i++) {
+    out[i] = v[i] ^ v[i + 8];
+  }
+}
+
+/// Computes the chaining value of a parent node.
+void ParentCV(const uint32_t left[8], const uint32_t right[8], uint32_t flags,
+              uint32_t out[8]) {
+  uint8_t block[kBlockLen];
+  for (int i = 0; i < 8; i++) {
+    for (int j = 0; j < 4; j++) {
+      block[4 * i + j] = static_cast<uint8_t>(left[i] >> (8 * j));
+      block[32 + 4 * i + j] = static_cast<uint8_t>(right[i] >> (8 * j));
+    }
+  }
+  Compress(kSHA256IV, block, kBlockLen, 0, kParent | flags, out);
+}
+
+/// Computes the chaining value of one whole chunk.
+void ChunkCV(const uint8_t* chunk, uint64_t counter, uint32_t out[8]) {
+  uint32_t cv[8];
+  std::copy(kSHA256IV, kSHA256IV + 8, cv);
+  for (size_t i = 0; i < kChunkLen / kBlockLen; i++) {
+    uint32_t flags = (i == 0 ? kChunkStart : 0) |
+        (i == kChunkLen / kBlockLen - 1 ? kChunkEnd : 0);
+    Compress(cv, chunk + i * kBlockLen, kBlockLen, counter, flags, cv);
+  }
+  memcpy(out, cv, sizeof(cv));
+}
+
+/// Computes the chaining value of a subtree of kSubtreeChunks whole chunks.
+void SubtreeCV(const uint8_t* data, uint64_t counter, uint32_t out[8]) {
+  std::vector<uint32_t> cvs(kSubtreeChunks * 8);
+  for (uint64_t i = 0; i < kSubtreeChunks; i++) {
+    ChunkCV(data + i * kChunkLen, counter + i, &cvs[i * 8]);
+  }
+  for (uint64_t n = kSubtreeChunks; n > 1; n /= 2) {
+    for (uint64_t i = 0; i < n / 2; i++) {
+      ParentCV(&cvs[2 * i * 8], &cvs[(2 * i + 1) * 8], 0, &cvs[i * 8]);
+    }
+  }
+  std::copy(cvs.begin(), cvs.begin() + 8, out);
+}
+
+size_t ChunkLength(const BLAKE3Context& ctx) {
+  return kBlockLen * ctx.blocks_compressed + ctx.block_len;
+}
+
+uint32_t ChunkStartFlag(const BLAKE3Context& ctx) {
+  return ctx.blocks_compressed == 0 ? kChunkStart : 0;
+}
+
+void ResetChunk(BLAKE3Context* ctx, uint64_t counter) {
+  std::copy(kSHA256IV, kSHA256IV + 8, ctx->chunk_cv);
+  ctx->chunk_counter = counter;
+  ctx->block_len = 0;
+  ctx->blocks_compressed = 0;
+}
+
+/**
+ * Pushes the chaining value of a new subtree, after merging the complete
+ * subtrees it finishes. 'total' is the number of subtrees of the new one's
+ * size hashed so far, including it.
+ */
+void PushCV(BLAKE3Context* ctx, const uint32_t cv[8], uint64_t total) {
+  uint32_t merged[8];
+  memcpy(merged, cv, sizeof(merged));
+  while ((total & 1) == 0) {
+    ctx->cv_stack_len--;
+    ParentCV(ctx->cv_stack[ctx->cv_stack_len], merged, 0, merged);
+    total >>= 1;
+  }
+  memcpy(ctx->cv_stack[ctx->cv_stack_len], merged, sizeof(merged));
+  ctx->cv_stack_len++;
+}
+
+/// Pushes the full current chunk and starts the next one.
+void FinishChunk(BLAKE3Context* ctx) {
+  uint32_t cv[8];
+  Compress(ctx->chunk_cv, ctx->block, ctx->block_len, ctx->chunk_counter,
+           ChunkStartFlag(*ctx) | kChunkEnd, cv);
+  uint64_t total = ctx->chunk_counter + 1;
+  PushCV(ctx, cv, total);
+  ResetChunk(ctx, total);
+}
+
+}  // anonymous namespace
+
+void Blake3Init(BLAKE3Context* ctx) {
+  ResetChunk(ctx, 0);
+  ctx->cv_stack_len = 0;
+}
+
+void Blake3Update(BLAKE3Context* ctx, const void* data, size_t size) {
+  const uint8_t* input = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    // A full chunk is only finished once more input arrives, because the
+    // last chunk of the message is finalized differently.
+    if (ChunkLength(*ctx) == kChunkLen) {
+      FinishChunk(ctx);
+    }
+    if (ctx->block_len == kBlockLen) {
+      Compress(ctx->chunk_cv, ctx->block, kBlockLen, ctx->chunk_counter,
+               ChunkStartFlag(*ctx), ctx->chunk_cv);
+      ctx->blocks_compressed++;
+      ctx->block_len = 0;
+    }
+    size_t n = std::min(kBlockLen - ctx->block_len, size);
+    memcpy(ctx->block + ctx->block_len, input, n);
+    ctx->block_len = static_cast<uint8_t>(ctx->block_len + n);
+    input += n;
+    size -= n;
+  }
+}
+
+void Blake3UpdateParallel(BLAKE3Context* ctx, const void* data, size_t size,
+                          ThreadPool* pool) {
+  const uint8_t* input = static_cast<const uint8_t*>(data);
+  // Hash serially up to a subtree boundary.
+  uint64_t consumed = ctx->chunk_counter * kChunkLen + ChunkLength(*ctx);
+  size_t head = static_cast<size_t>(
+      (kSubtreeLen - consumed % kSubtreeLen) % kSubtreeLen);
+  // At least one byte stays for the serial tail, which keeps the last chunk
+  // in the context for Final().
+  if (size <= head + 2 * kSubtreeLen) {
+    Blake3Update(ctx, input, size);
+    return;
+  }
+  Blake3Update(ctx, input, head);
+  input += head;
+  size -= head;
+  if (ChunkLength(*ctx) == kChunkLen) {
+    FinishChunk(ctx);
+  }
+
+  const size_t num_subtrees = (size - 1) / kSubtreeLen;
+  const uint64_t first_chunk = ctx->chunk_counter;
+  std::vector<uint32_t> cvs(num_subtrees * 8);
+  std::mutex mutex;
+  std::condition_variable done_cond;
+  size_t done = 0;
+  for (size_t i = 0; i < num_subtrees; i++) {
+    pool->Schedule([&, i] {
+      SubtreeCV(input + i * kSubtreeLen, first_chunk + i * kSubtreeChunks,
+                &cvs[i * 8]);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (++done == num_subtrees) {
+        done_cond.notify_one();
+      }
+    });
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cond.wait(lock, [&] { return done == num_subtrees; });
+  }
+
+  // Every subtree on the stack is at least as large as these, since the
+  // chunk counter is a multiple of kSubtreeChunks.
+  for (size_t i = 0; i < num_subtrees; i++) {
+    PushCV(ctx, &cvs[i * 8], first_chunk / kSubtreeChunks + i + 1);
+  }
+  ResetChunk(ctx, first_chunk + num_subtrees * kSubtreeChunks);
+  Blake3Update(ctx, input + num_subtrees * kSubtreeLen,
+               size - num_subtrees * kSubtreeLen);
+}
+
+void Blake3Final(const BLAKE3Context& ctx, unsigned char* out) {
+  // The output node is the last chunk, then each parent up the stack.
+  uint32_t cv[8];
+  memcpy(cv, ctx.chunk_cv, sizeof(cv));
+  uint8_t block[kBlockLen];
+  memset(block, 0, sizeof(block));
+  memcpy(block, ctx.block, ctx.block_len);
+  uint8_t block_len = ctx.block_len;
+  uint64_t counter = ctx.chunk_counter;
+  uint32_t flags = ChunkStartFlag(ctx) | kChunkEnd;
+  for (int i = ctx.cv_stack_len - 1; i >= 0; i--) {
+    uint32_t right[8];
+    Compress(cv, block, block_len, counter, flags, right);
+    for (int w = 0; w < 8; w++) {
+      for (int j = 0; j < 4; j++) {
+        block[4 * w + j] = static_cast<uint8_t>(ctx.cv_stack[i][w] >> (8 * j));
+        block[32 + 4 * w + j] = static_cast<uint8_t>(right[w] >> (8 * j));
+      }
+    }
+    std::copy(kSHA256IV, kSHA256IV + 8, cv);
+    block_len = kBlockLen;
+    counter = 0;
+    flags = kParent;
+  }
+  // The root is compressed with the output block counter instead, which is
+  // 0 for the first 64 bytes of output.
+  uint32_t root[8];
+  Compress(cv, block, block_len, 0, flags | kRoot, root);
+  for (int w = 0; w < 8; w++) {
+    for (int j = 0; j < 4; j++) {
+      out[4 * w + j] = static_cast<unsigned char>(root[w] >> (8 * j));
+    }
+  }
+}
+
+}  // namespace hash_internal
+}  // namespace vobla
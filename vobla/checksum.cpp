@@ -0,0 +1,330 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file checksum.cpp
+ * \brief CRC32C and xxHash64 kernels for the non-cryptographic digests.
+ */
+
+#include <string.h>
+#include "vobla/hash.h"
+#include "vobla/hash_internal.h"
+#include "vobla/sysinfo.h"
+
+#if defined(VOBLA_HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+namespace vobla {
+namespace hash_internal {
+
+namespace {
+
+// ---- CRC32C ----
+
+/// The reflected Castagnoli polynomial.
+const uint32_t kCrc32cPoly = 0x82f63b78;
+
+/// Slicing-by-8 tables for the portable implementation.
+struct Crc32cTables {
+  uint32_t t[8][256];
+
+  Crc32cTables() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int k = 0; k < 8; k++) {
+        crc = (crc >> 1) ^ (kCrc32cPoly & (0 - (crc & 1)));
+      }
+      t[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+      for (int k = 1; k < 8; k++) {
+        t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+      }
+    }
+  }
+};
+
+const Crc32cTables& tables() {
+  static const Crc32cTables kTables;
+  return kTables;
+}
+
+inline uint64_t Load64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t Load32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/// Updates a raw (not pre/post-inverted) CRC register. Little-endian only.
+uint32_t Crc32cRawPortable(uint32_t crc, const uint8_t* p, size_t n) {
+  const Crc32cTables& tab = tables();
+  while (n >= 8) {
+    uint64_t v = Load64(p) ^ crc;
+    crc = tab.t[7][v & 0xff] ^ tab.t[6][(v >> 8) & 0xff] ^
+        tab.t[5][(v >> 16) & 0xff] ^ tab.t[4][(v >> 24) & 0xff] ^
+        tab.t[3][(v >> 32) & 0xff] ^ tab.t[2][(v >> 40) & 0xff] ^
+        tab.t[1][(v >> 48) & 0xff] ^ tab.t[0][v >> 56];
+    p += 8;
+    n -= 8;
+  }
+  while (n--) {
+    crc = (crc >> 8) ^ tab.t[0][(crc ^ *p++) & 0xff];
+  }
+  return crc;
+}
+
+/// Multiplies two polynomials modulo P, in the reflected representation.
+uint32_t MultModP(uint32_t a, uint32_t b) {
+  uint32_t m = 1u << 31;
+  uint32_t p = 0;
+  while (true) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) {
+        break;
+      }
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ kCrc32cPoly : b >> 1;
+  }
+  return p;
+}
+
+/// Returns x^n modulo P, in the reflected representation.
+uint32_t XPowModP(uint64_t n) {
+  uint32_t result = 1u << 31;  // x^0
+  uint32_t square = 1u << 30;  // x^1
+  while (n) {
+    if (n & 1) {
+      result = MultModP(result, square);
+    }
+    square = MultModP(square, square);
+    n >>= 1;
+  }
+  return result;
+}
+
+#if defined(VOBLA_HAVE_X86_SIMD)
+
+/// Each of the three interleaved streams covers this many bytes.
+const size_t kStripe = 1024;
+
+/**
+ * Constants that shift a CRC register over kStripe and 2 * kStripe zero
+ * bytes. A 32x32 carry-less multiply followed by one crc32 instruction
+ * computes crc * x^(8n) mod P when the constant is x^(8n - 33).
+ */
+struct Crc32cShifts {
+  uint64_t one;
+  uint64_t two;
+
+  Crc32cShifts()
+      : one(XPowModP(8 * kStripe - 33)), two(XPowModP(16 * kStripe - 33)) {}
+};
+
+__attribute__((target("sse4.2,pclmul")))
+inline uint32_t ShiftCrc(uint32_t crc, uint64_t constant) {
+  __m128i product = _mm_clmulepi64_si128(
+      _mm_cvtsi32_si128(static_cast<int>(crc)),
+      _mm_cvtsi64_si128(static_cast<int64_t>(constant)), 0);
+  return static_cast<uint32_t>(
+      _mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(product))));
+}
+
+__attribute__((target("sse4.2,pclmul")))
+uint32_t Crc32cRawHardware(uint32_t crc, const uint8_t* p, size_t n) {
+  static const Crc32cShifts kShifts;
+  uint64_t crc0 = crc;
+  while (n > 0 && (reinterpret_cast<uintptr_t>(p) & 7)) {
+    crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *p++);
+    n--;
+  }
+  // The crc32 instruction has a latency of 3 cycles but a throughput of 1,
+  // so three independent streams keep the unit busy. The partial CRCs are
+  // then folded together with carry-less multiplies.
+  while (n >= 3 * kStripe) {
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    for (size_t i = 0; i < kStripe; i += 8) {
+      crc0 = _mm_crc32_u64(crc0, Load64(p + i));
+      crc1 = _mm_crc32_u64(crc1, Load64(p + kStripe + i));
+      crc2 = _mm_crc32_u64(crc2, Load64(p + 2 * kStripe + i));
+    }
+    crc0 = ShiftCrc(static_cast<uint32_t>(crc0), kShifts.two) ^
+        ShiftCrc(static_cast<uint32_t>(crc1), kShifts.one) ^ crc2;
+    p += 3 * kStripe;
+    n -= 3 * kStripe;
+  }
+  while (n >= 8) {
+    crc0 = _mm_crc32_u64(crc0, Load64(p));
+    p += 8;
+    n -= 8;
+  }
+  while (n--) {
+    crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *p++);
+  }
+  return static_cast<uint32_t>(crc0);
+}
+
+#endif  // VOBLA_HAVE_X86_SIMD
+
+bool HasHardwareCrc32c() {
+#if defined(VOBLA_HAVE_X86_SIMD)
+  static const bool kSupported = SysInfo::HasCpuFeature(SysInfo::SSE4_2) &&
+      SysInfo::HasCpuFeature(SysInfo::PCLMUL);
+  return kSupported;
+#else
+  return false;
+#endif
+}
+
+// ---- xxHash64 ----
+
+const uint64_t kPrime64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kPrime64_3 = 0x165667B19E3779F9ULL;
+const uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t kPrime64_5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t Rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t XXH64Round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime64_2;
+  acc = Rotl64(acc, 31);
+  return acc * kPrime64_1;
+}
+
+inline uint64_t XXH64MergeRound(uint64_t acc, uint64_t val) {
+  acc ^= XXH64Round(0, val);
+  return acc * kPrime64_1 + kPrime64_4;
+}
+
+/// Consumes whole 32-byte stripes, returning the number of bytes used.
+size_t XXH64Stripes(uint64_t* v, const uint8_t* p, size_t n) {
+  uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+  size_t consumed = 0;
+  while (n - consumed >= 32) {
+    const uint8_t* q = p + consumed;
+    v1 = XXH64Round(v1, Load64(q));
+    v2 = XXH64Round(v2, Load64(q + 8));
+    v3 = XXH64Round(v3, Load64(q + 16));
+    v4 = XXH64Round(v4, Load64(q + 24));
+    consumed += 32;
+  }
+  v[0] = v1;
+  v[1] = v2;
+  v[2] = v3;
+  v[3] = v4;
+  return consumed;
+}
+
+}  // anonymous namespace
+
+uint32_t Crc32cExtend(uint32_t crc, const void* data, size_t size) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+#if defined(VOBLA_HAVE_X86_SIMD)
+  if (HasHardwareCrc32c()) {
+    return ~Crc32cRawHardware(~crc, p, size);
+  }
+#endif
+  return ~Crc32cRawPortable(~crc, p, size);
+}
+
+uint32_t Crc32cExtendPortable(uint32_t crc, const void* data, size_t size) {
+  return ~Crc32cRawPortable(~crc, static_cast<const uint8_t*>(data), size);
+}
+
+void XXHash64Init(XXHash64Context* ctx, uint64_t seed) {
+  ctx->total_length = 0;
+  ctx->seed = seed;
+  ctx->v[0] = seed + kPrime64_1 + kPrime64_2;
+  ctx->v[1] = seed + kPrime64_2;
+  ctx->v[2] = seed;
+  ctx->v[3] = seed - kPrime64_1;
+  ctx->buffered = 0;
+}
+
+void XXHash64Update(XXHash64Context* ctx, const void* data, size_t size) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  ctx->total_length += size;
+  if (ctx->buffered + size < 32) {
+    memcpy(ctx->buffer + ctx->buffered, p, size);
+    ctx->buffered += static_cast<uint32_t>(size);
+    return;
+  }
+  if (ctx->buffered) {
+    size_t fill = 32 - ctx->buffered;
+    memcpy(ctx->buffer + ctx->buffered, p, fill);
+    XXH64Stripes(ctx->v, ctx->buffer, 32);
+    p += fill;
+    size -= fill;
+    ctx->buffered = 0;
+  }
+  size_t consumed = XXH64Stripes(ctx->v, p, size);
+  ctx->buffered = static_cast<uint32_t>(size - consumed);
+  memcpy(ctx->buffer, p + consumed, ctx->buffered);
+}
+
+uint64_t XXHash64Final(const XXHash64Context& ctx) {
+  uint64_t h;
+  if (ctx.total_length >= 32) {
+    h = Rotl64(ctx.v[0], 1) + Rotl64(ctx.v[1], 7) + Rotl64(ctx.v[2], 12) +
+        Rotl64(ctx.v[3], 18);
+    for (int i = 0; i < 4; i++) {
+      h = XXH64MergeRound(h, ctx.v[i]);
+    }
+  } else {
+    h = ctx.seed + kPrime64_5;
+  }
+  h += ctx.total_length;
+
+  const uint8_t* p = ctx.buffer;
+  size_t n = ctx.buffered;
+  while (n >= 8) {
+    h ^= XXH64Round(0, Load64(p));
+    h = Rotl64(h, 27) * kPrime64_1 + kPrime64_4;
+    p += 8;
+    n -= 8;
+  }
+  if (n >= 4) {
+    h ^= static_cast<uint64_t>(Load32(p)) * kPrime64_1;
+    h = Rotl64(h, 23) * kPrime64_2 + kPrime64_3;
+    p += 4;
+    n -= 4;
+  }
+  while (n--) {
+    h ^= (*p++) * kPrime64_5;
+    h = Rotl64(h, 11) * kPrime64_1;
+  }
+  h ^= h >> 33;
+  h *= kPrime64_2;
+  h ^= h >> 29;
+  h *= kPrime64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+}  // namespace hash_internal
+}  // namespace vobla
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <algorithm>
+#include "vobla/chunker.h"
+
+using std::min;
+
+namespace vobla {
+
+namespace {
+
+/**
+ * Random values for each byte. They are generated from a fixed seed, so
+ * chunk boundaries are stable across runs and builds.
+ */
+struct GearTable {
+  uint64_t value[256];
+
+  /// value[] shifted left by one, to roll two bytes at a time.
+  uint64_t shifted[256];
+
+  GearTable() {
+    uint64_t state = 0x766f626c61636463ULL;  // "voblacdc"
+    for (int i = 0; i < 256; i++) {
+      // splitmix64
+      uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      value[i] = z ^ (z >> 31);
+      shifted[i] = value[i] << 1;
+    }
+  }
+};
+
+const GearTable kGear;
+
+/**
+ * The 'bits' bits below the top one. High bits depend on the most
+ * preceding bytes; bit 63 is left out so that the mask can be shifted
+ * left by one without losing a bit (see RollUntil()).
+ */
+uint64_t HighBits(int bits) {
+  return bits <= 0 ? 0 : (~0ULL << (64 - bits)) >> 1;
+}
+
+/**
+ * Rolls the hash over data[*i, end) until it matches 'mask'. Returns true
+ * and leaves *i after the matching byte on a match.
+ */
+inline bool RollUntil(const uint8_t* data, size_t end, uint64_t mask,
+                      uint64_t* hash, size_t* i) {
+  uint64_t h = *hash;
+  size_t j = *i;
+  // Two bytes per step. The hash after the first byte is h1 = 2h + G[b0],
+  // and h1 matches 'mask' exactly when 2 * h1 = 4h + 2G[b0] matches
+  // mask << 1, so the step needs one shift instead of two.
+  const uint64_t shifted_mask = mask << 1;
+  for (; j + 2 <= end; j += 2) {
+    uint64_t t = (h << 2) + kGear.shifted[data[j]];
+    if (!(t & shifted_mask)) {
+      *hash = (h << 1) + kGear.value[data[j]];
+      *i = j + 1;
+      return true;
+    }
+    h = t + kGear.value[data[j + 1]];
+    if (!(h & mask)) {
+      *hash = h;
+      *i = j + 2;
+      return true;
+    }
+  }
+  for (; j < end; j++) {
+    h = (h << 1) + kGear.value[data[j]];
+    if (!(h & mask)) {
+      *hash = h;
+      *i = j + 1;
+      return true;
+    }
+  }
+  *hash = h;
+  *i = std::max(*i, end);
+  return false;
+}
+
+}  // anonymous namespace
+
+GearCutter::GearCutter(const ChunkerOptions& options) : options_(options) {
+  CHECK_GT(options.min_size, 0u);
+  CHECK_LE(options.min_size, options.avg_size);
+  CHECK_LE(options.avg_size, options.max_size);
+  int bits = 0;
+  while ((2ULL << bits) <= options.avg_size) {
+    bits++;
+  }
+  // Normalization level 2 of FastCDC.
+  mask_small_ = HighBits(bits + 2);
+  mask_large_ = HighBits(bits - 2);
+}
+
+void GearCutter::Reset() {
+  hash_ = 0;
+  chunk_size_ = 0;
+}
+
+size_t GearCutter::Scan(const uint8_t* data, size_t size, bool* cut) {
+  const size_t pos = chunk_size_;
+  size_t i = 0;
+  if (pos < options_.min_size) {
+    // Boundaries are never placed before min_size: skip hashing.
+    i = min(size, options_.min_size - pos);
+  }
+  const size_t avg_end =
+      pos < options_.avg_size ? min(size, options_.avg_size - pos) : 0;
+  const size_t max_end = min(size, options_.max_size - pos);
+  *cut = RollUntil(data, avg_end, mask_small_, &hash_, &i) ||
+         RollUntil(data, max_end, mask_large_, &hash_, &i) ||
+         pos + i == options_.max_size;
+  if (*cut) {
+    Reset();
+  } else {
+    chunk_size_ += i;
+  }
+  return i;
+}
+
+}  // namespace vobla
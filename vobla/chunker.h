@@ -0,0 +1,179 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file chunker.h
+ * \brief Content-defined chunking.
+ *
+ * Chunk boundaries are placed where a Gear rolling hash of the last 64
+ * bytes matches a mask, so inserting or deleting bytes only moves the
+ * boundaries near the edit. The boundaries follow FastCDC: nothing is
+ * hashed before the minimum chunk size, and a stricter mask before the
+ * average size and a looser one after it keep chunk sizes close to the
+ * average.
+ */
+
+#ifndef VOBLA_CHUNKER_H_
+#define VOBLA_CHUNKER_H_
+
+#include <boost/utility.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include "vobla/digest.h"
+#include "vobla/gutil/strings/stringpiece.h"
+
+namespace vobla {
+
+/// Chunk size limits, in bytes.
+struct ChunkerOptions {
+  size_t min_size = 2 << 10;
+
+  /// Rounded down to a power of two.
+  size_t avg_size = 8 << 10;
+
+  size_t max_size = 64 << 10;
+};
+
+/**
+ * \class GearCutter
+ * \brief Finds content-defined chunk boundaries in a byte stream.
+ */
+class GearCutter : boost::noncopyable {
+ public:
+  explicit GearCutter(const ChunkerOptions& options);
+
+  /**
+   * \brief Scans the next bytes of the stream for the end of the current
+   * chunk.
+   *
+   * \param data the next bytes of the stream.
+   * \param size the number of bytes in 'data'.
+   * \param[out] cut set to true if the returned bytes end the chunk.
+   * \return the number of bytes of 'data' in the current chunk. It is
+   * 'size' unless the chunk ends inside 'data'.
+   */
+  size_t Scan(const uint8_t* data, size_t size, bool* cut);
+
+  /// Starts a new chunk, e.g. at the end of the stream.
+  void Reset();
+
+ private:
+  ChunkerOptions options_;
+
+  /// Used before reaching the average size; has more bits than mask_large_.
+  uint64_t mask_small_;
+
+  /// Used after reaching the average size.
+  uint64_t mask_large_;
+
+  uint64_t hash_ = 0;
+
+  /// The number of bytes in the current chunk so far.
+  size_t chunk_size_ = 0;
+};
+
+/**
+ * \class Chunker
+ * \brief Splits a stream into content-defined chunks and hashes them in
+ * the same pass.
+ *
+ * 'HashDigest' is any of the digest classes, e.g. SHA1Digest. The data is
+ * fed to the digest as it is scanned, so no chunk is ever buffered.
+ */
+template <typename HashDigest>
+class Chunker : boost::noncopyable {
+ public:
+  struct Chunk {
+    /// The offset of the chunk in the stream.
+    uint64_t offset;
+
+    uint64_t length;
+
+    Digest<HashDigest::LENGTH> digest;
+  };
+
+  typedef std::function<void(const Chunk&)> Callback;
+
+  /// 'callback' receives the chunks in stream order.
+  Chunker(const ChunkerOptions& options, Callback callback)
+      : cutter_(options), callback_(callback) {
+    digest_.Init();
+  }
+
+  /// Feeds the next bytes of the stream.
+  void Update(const void* buffer, size_t size);
+
+  void Update(StringPiece buffer) { Update(buffer.data(), buffer.size()); }
+
+  /// Emits the last chunk and starts a new stream.
+  void Final();
+
+ private:
+  void EmitChunk();
+
+  GearCutter cutter_;
+
+  Callback callback_;
+
+  HashDigest digest_;
+
+  uint64_t offset_ = 0;
+
+  uint64_t length_ = 0;
+};
+
+template <typename HashDigest>
+void Chunker<HashDigest>::Update(const void* buffer, size_t size) {
+  const uint8_t* data = static_cast<const uint8_t*>(buffer);
+  while (size > 0) {
+    bool cut;
+    size_t n = cutter_.Scan(data, size, &cut);
+    digest_.Update(data, n);
+    length_ += n;
+    data += n;
+    size -= n;
+    if (cut) {
+      EmitChunk();
+    }
+  }
+}
+
+template <typename HashDigest>
+void Chunker<HashDigest>::Final() {
+  if (length_ > 0) {
+    EmitChunk();
+  }
+  cutter_.Reset();
+  offset_ = 0;
+}
+
+template <typename HashDigest>
+void Chunker<HashDigest>::EmitChunk() {
+  digest_.Final();
+  Chunk chunk;
+  chunk.offset = offset_;
+  chunk.length = length_;
+  chunk.digest = digest_.value();
+  callback_(chunk);
+  offset_ += length_;
+  length_ = 0;
+  digest_.Init();
+}
+
+}  // namespace vobla
+
+#endif  // VOBLA_CHUNKER_H_
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <string>
+#include "vobla/chunker.h"
+#include "vobla/hash.h"
+
+using std::string;
+
+namespace vobla {
+
+namespace {
+
+const size_t kInputSize = 64 << 20;
+
+const string& Input() {
+  static const string input = [] {
+    string buf(kInputSize, '\0');
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < buf.size(); i++) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      buf[i] = static_cast<char>(x);
+    }
+    return buf;
+  }();
+  return input;
+}
+
+/// Finding boundaries only, with state.range(0) as the average size.
+void BM_GearCutter(benchmark::State& state) {
+  const string& input = Input();
+  ChunkerOptions options;
+  options.avg_size = state.range(0);
+  options.min_size = options.avg_size / 4;
+  options.max_size = options.avg_size * 8;
+  GearCutter cutter(options);
+  size_t chunks = 0;
+  for (auto _ : state) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(input.data());
+    size_t size = input.size();
+    while (size > 0) {
+      bool cut;
+      size_t n = cutter.Scan(data, size, &cut);
+      data += n;
+      size -= n;
+      chunks += cut;
+    }
+    cutter.Reset();
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.counters["chunks"] = benchmark::Counter(
+      chunks, benchmark::Counter::kAvgIterations);
+}
+
+/// Chunking and hashing in one pass.
+template <typename HashDigest>
+void BM_Chunker(benchmark::State& state) {
+  const string& input = Input();
+  size_t chunks = 0;
+  Chunker<HashDigest> chunker(
+      ChunkerOptions(),
+      [&chunks](const typename Chunker<HashDigest>::Chunk&) { chunks++; });
+  for (auto _ : state) {
+    chunker.Update(input);
+    chunker.Final();
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+  state.counters["chunks"] = benchmark::Counter(
+      chunks, benchmark::Counter::kAvgIterations);
+}
+
+}  // anonymous namespace
+
+BENCHMARK(BM_GearCutter)->RangeMultiplier(4)->Range(4 << 10, 64 << 10);
+BENCHMARK_TEMPLATE(BM_Chunker, SHA1Digest);
+BENCHMARK_TEMPLATE(BM_Chunker, CRC32CDigest);
+
+}  // namespace vobla
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <vector>
+#include "vobla/chunker.h"
+#include "vobla/hash.h"
+
+using std::string;
+using std::vector;
+
+namespace vobla {
+
+namespace {
+
+typedef Chunker<SHA1Digest> SHA1Chunker;
+
+string MakeInput(size_t size) {
+  string input(size, '\0');
+  uint64_t x = 88172645463325252ULL;
+  for (size_t i = 0; i < size; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    input[i] = static_cast<char>(x);
+  }
+  return input;
+}
+
+/// Chunks 'input', feeding it in pieces of at most 'piece' bytes.
+vector<SHA1Chunker::Chunk> Chunk(const string& input, size_t piece) {
+  vector<SHA1Chunker::Chunk> chunks;
+  SHA1Chunker chunker(ChunkerOptions(),
+                      [&chunks](const SHA1Chunker::Chunk& chunk) {
+                        chunks.push_back(chunk);
+                      });
+  for (size_t offset = 0; offset < input.size(); offset += piece) {
+    chunker.Update(StringPiece(input).substr(offset, piece));
+  }
+  chunker.Final();
+  return chunks;
+}
+
+}  // anonymous namespace
+
+TEST(ChunkerTest, ChunksCoverTheInput) {
+  const string input = MakeInput(1 << 20);
+  const ChunkerOptions options;
+  auto chunks = Chunk(input, input.size());
+  ASSERT_GT(chunks.size(), 1u);
+  uint64_t offset = 0;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    const auto& chunk = chunks[i];
+    EXPECT_EQ(offset, chunk.offset);
+    EXPECT_LE(chunk.length, options.max_size);
+    if (i + 1 < chunks.size()) {
+      EXPECT_GE(chunk.length, options.min_size);
+    }
+    EXPECT_EQ(SHA1Hasher::Hash(StringPiece(input).substr(chunk.offset,
+                                                         chunk.length)),
+              chunk.digest);
+    offset += chunk.length;
+  }
+  EXPECT_EQ(input.size(), offset);
+  // Normalized chunking keeps the mean near the average size.
+  size_t mean = input.size() / chunks.size();
+  EXPECT_GT(mean, options.avg_size / 2);
+  EXPECT_LT(mean, options.avg_size * 2);
+}
+
+TEST(ChunkerTest, BoundariesDoNotDependOnUpdateSizes) {
+  const string input = MakeInput(300000);
+  auto expected = Chunk(input, input.size());
+  for (size_t piece : {1, 63, 4096, 65537}) {
+    auto chunks = Chunk(input, piece);
+    ASSERT_EQ(expected.size(), chunks.size()) << piece;
+    for (size_t i = 0; i < chunks.size(); i++) {
+      EXPECT_EQ(expected[i].length, chunks[i].length);
+      EXPECT_EQ(expected[i].digest, chunks[i].digest);
+    }
+  }
+}
+
+TEST(ChunkerTest, InsertionOnlyChangesNearbyChunks) {
+  string input = MakeInput(1 << 20);
+  auto before = Chunk(input, input.size());
+  input.insert(input.size() / 2, "inserted");
+  auto after = Chunk(input, input.size());
+
+  std::set<Digest<SHA1Digest::LENGTH>> digests;
+  for (const auto& chunk : before) {
+    digests.insert(chunk.digest);
+  }
+  size_t changed = 0;
+  for (const auto& chunk : after) {
+    changed += digests.count(chunk.digest) == 0;
+  }
+  EXPECT_GE(changed, 1u);
+  EXPECT_LE(changed, 2u);
+}
+
+TEST(ChunkerTest, MaxSizeOnUniformInput) {
+  ChunkerOptions options;
+  options.min_size = 64;
+  options.avg_size = 256;
+  options.max_size = 1000;
+  vector<uint64_t> lengths;
+  Chunker<MD5Digest> chunker(options,
+                             [&lengths](const Chunker<MD5Digest>::Chunk& c) {
+                               lengths.push_back(c.length);
+                             });
+  // A constant input gives a constant hash, which never matches the mask.
+  chunker.Update(string(2500, 'x'));
+  chunker.Final();
+  EXPECT_EQ((vector<uint64_t>{1000, 1000, 500}), lengths);
+
+  // The chunker starts a new stream after Final().
+  lengths.clear();
+  chunker.Final();
+  EXPECT_TRUE(lengths.empty());
+}
+
+}  // namespace vobla
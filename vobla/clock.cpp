@@ -14,12 +14,34 @@
  * limitations under the License.
  */
 
-#include <sys/time.h>
+#include <glog/logging.h>
+#include <time.h>
 #include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include "vobla/clock.h"
 
 namespace vobla {
 
+namespace {
+
+const int64_t kNanosPerSecond = 1000000000;
+
+int64_t clock_gettime_ns(clockid_t clock_id) {
+  timespec ts;
+  clock_gettime(clock_id, &ts);
+  return ts.tv_sec * kNanosPerSecond + ts.tv_nsec;
+}
+
+}  // anonymous namespace
+
+int64_t Clock::now_ns() {
+  return std::llround(now() * kNanosPerSecond);
+}
+
 /**
  * \brief Real wall clock.
  */
@@ -29,26 +51,113 @@ class RealClock : public Clock {
 
   double now();
 
+  int64_t now_ns();
+
   void sleep(double seconds);
 };
 
 double RealClock::now() {
-  timeval curtime;
-  gettimeofday(&curtime, nullptr);
-  return curtime.tv_sec + static_cast<double>(curtime.tv_usec) / 1000000;
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + static_cast<double>(ts.tv_nsec) / kNanosPerSecond;
+}
+
+int64_t RealClock::now_ns() {
+  return clock_gettime_ns(CLOCK_REALTIME);
 }
 
 void RealClock::sleep(double seconds) {
   usleep(seconds * 1000000);
 }
 
+/**
+ * \brief CLOCK_MONOTONIC, read through the vDSO without a system call.
+ */
+class MonotonicClock : public RealClock {
+ public:
+  MonotonicClock() = default;
+
+  double now();
+
+  int64_t now_ns();
+};
+
+double MonotonicClock::now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + static_cast<double>(ts.tv_nsec) / kNanosPerSecond;
+}
+
+int64_t MonotonicClock::now_ns() {
+  return clock_gettime_ns(CLOCK_MONOTONIC);
+}
+
 static RealClock* global_clock = new RealClock;
 
+static MonotonicClock* global_monotonic_clock = new MonotonicClock;
+
 // static
 Clock* Clock::real_clock() {
   return global_clock;
 }
 
+// static
+Clock* Clock::monotonic_clock() {
+  return global_monotonic_clock;
+}
+
+// static
+Clock* Clock::coarse_clock() {
+  static CoarseClock* clock = new CoarseClock;
+  return clock;
+}
+
+// --- Coarse Clock ----
+
+constexpr double CoarseClock::kDefaultResolution;
+
+struct CoarseClock::Ticker {
+  std::mutex mutex;
+
+  std::condition_variable stop_cond;
+
+  bool stopped = false;
+
+  std::thread thread;
+};
+
+CoarseClock::CoarseClock(Clock* source, double resolution)
+    : source_(source), resolution_(resolution), ticker_(new Ticker) {
+  CHECK_GT(resolution, 0);
+  Update();
+  const auto interval = std::chrono::nanoseconds(
+      std::llround(resolution * kNanosPerSecond));
+  ticker_->thread = std::thread([this, interval] {
+    std::unique_lock<std::mutex> lock(ticker_->mutex);
+    while (!ticker_->stop_cond.wait_for(lock, interval,
+                                        [this] { return ticker_->stopped; })) {
+      Update();
+    }
+  });
+}
+
+CoarseClock::~CoarseClock() {
+  {
+    std::lock_guard<std::mutex> lock(ticker_->mutex);
+    ticker_->stopped = true;
+  }
+  ticker_->stop_cond.notify_one();
+  ticker_->thread.join();
+}
+
+void CoarseClock::sleep(double seconds) {
+  source_->sleep(seconds);
+}
+
+void CoarseClock::Update() {
+  now_ns_.store(source_->now_ns(), std::memory_order_relaxed);
+}
+
 // --- Fake Clock ----
 
 FakeClock::FakeClock(double start) : second_(start) {
@@ -18,6 +18,9 @@
 #define VOBLA_CLOCK_H_
 
 #include <boost/utility.hpp>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
 
 namespace vobla {
 
@@ -34,12 +37,99 @@ class Clock : boost::noncopyable {
   /// Returns the global wall-time clock
   static Clock* real_clock();
 
+  /**
+   * \brief Returns the global monotonic clock.
+   *
+   * Its time starts at an arbitrary point and never jumps when the wall time
+   * is set, so it is the clock to measure intervals with.
+   */
+  static Clock* monotonic_clock();
+
+  /**
+   * \brief Returns the global coarse wall-time clock, which is at most about
+   * a millisecond behind real_clock().
+   *
+   * Use it where a rough "now" is enough, e.g. TTLs and log stamps. Its ticker
+   * thread starts on the first call. The thread does not survive fork(), so
+   * in a child forked after that call this clock stops advancing.
+   */
+  static Clock* coarse_clock();
+
   /// Returns the current timestamp.
   virtual double now() = 0;
 
+  /**
+   * \brief Returns the current timestamp in nanoseconds.
+   *
+   * The default implementation rounds now().
+   */
+  virtual int64_t now_ns();
+
   virtual void sleep(double seconds) = 0;
 };
 
+/**
+ * \class CoarseClock
+ * \brief A clock that caches the time of another clock, refreshed by a
+ * background thread every 'resolution' seconds.
+ *
+ * Reading it is a single atomic load, which is inlined when called through
+ * a CoarseClock pointer. The cached time lags the source clock by up to
+ * 'resolution' plus the scheduling delay of the ticker thread, and never
+ * goes backwards unless the source does.
+ *
+ * The ticker thread does not survive fork(): in the child, a CoarseClock
+ * created before the fork keeps returning the time of the fork.
+ */
+class CoarseClock final : public Clock {
+ public:
+  /// The default refresh interval, in seconds.
+  static constexpr double kDefaultResolution = 0.001;
+
+  /**
+   * \brief Starts caching the time of 'source'.
+   *
+   * \param source the clock to cache, which must be thread-safe and outlive
+   * this clock.
+   * \param resolution the refresh interval in seconds; must be positive.
+   */
+  explicit CoarseClock(Clock* source = Clock::real_clock(),
+                       double resolution = kDefaultResolution);
+
+  /// Stops the ticker thread.
+  virtual ~CoarseClock();
+
+  /// Returns the cached timestamp in seconds.
+  virtual double now() {
+    return now_ns() / 1e9;
+  }
+
+  /// Returns the cached timestamp in nanoseconds.
+  virtual int64_t now_ns() {
+    return now_ns_.load(std::memory_order_relaxed);
+  }
+
+  /// Sleeps on the source clock.
+  virtual void sleep(double seconds);
+
+  double resolution() const { return resolution_; }
+
+ private:
+  struct Ticker;
+
+  /// Refreshes the cached time from the source clock. Only the constructor
+  /// and then the ticker thread call it, so stores never race.
+  void Update();
+
+  Clock* source_;
+
+  const double resolution_;
+
+  std::atomic<int64_t> now_ns_;
+
+  std::unique_ptr<Ticker> ticker_;
+};
+
 /**
  * \class FakeClock
  * \brief A fake clock object that is easy to be used in dependancy injection
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VOBLA_DIGEST_H_
+#define VOBLA_DIGEST_H_
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <array>
+#include <functional>
+#include <string>
+#include "vobla/gutil/strings/stringpiece.h"
+#include "vobla/hex.h"
+#include "vobla/status.h"
+
+namespace vobla {
+
+/**
+ * \class Digest
+ * \brief The value of a L-byte hash digest, without any hashing state.
+ *
+ * A Digest is trivially copyable and exactly L bytes large, so it is the
+ * type to keep in large in-memory indexes. It orders like the digest
+ * classes (lexicographically by byte), but compares the first 8 bytes as
+ * one integer before touching the rest. std::hash uses those bytes
+ * directly, since digests are already uniformly distributed.
+ */
+template <size_t L>
+class Digest {
+ public:
+  enum { LENGTH = L };
+
+  /// Constructs an all-zero digest.
+  Digest() { bytes_.fill(0); }
+
+  /// Constructs a digest from LENGTH bytes.
+  explicit Digest(const uint8_t* bytes) {
+    memcpy(bytes_.data(), bytes, LENGTH);
+  }
+
+  const uint8_t* data() const { return bytes_.data(); }
+
+  uint8_t* data() { return bytes_.data(); }
+
+  static constexpr size_t size() { return LENGTH; }
+
+  /**
+   * \brief Returns the leading (up to 8) bytes as an integer.
+   *
+   * The bytes are read in memory order, so the value is only meaningful
+   * for hashing and equality.
+   */
+  uint64_t prefix() const {
+    uint64_t value = 0;
+    memcpy(&value, bytes_.data(), kPrefixLength);
+    return value;
+  }
+
+  bool operator==(const Digest& rhs) const {
+    return prefix() == rhs.prefix() &&
+        memcmp(bytes_.data() + kPrefixLength, rhs.bytes_.data() + kPrefixLength,
+               LENGTH - kPrefixLength) == 0;
+  }
+
+  bool operator!=(const Digest& rhs) const { return !(*this == rhs); }
+
+  bool operator<(const Digest& rhs) const {
+    uint64_t lhs_prefix = ordered_prefix();
+    uint64_t rhs_prefix = rhs.ordered_prefix();
+    if (lhs_prefix != rhs_prefix) {
+      return lhs_prefix < rhs_prefix;
+    }
+    return memcmp(bytes_.data() + kPrefixLength,
+                  rhs.bytes_.data() + kPrefixLength,
+                  LENGTH - kPrefixLength) < 0;
+  }
+
+  /// Returns the hexadecimal digest.
+  std::string hexdigest() const;
+
+  /// Writes the 2 * LENGTH hexadecimal characters to 'out', without a NUL.
+  void hexdigest(char* out) const { HexEncode(bytes_.data(), LENGTH, out); }
+
+  /**
+   * \brief Parses the digest from its hexadecimal form.
+   *
+   * The digest is left unchanged if 'hex' does not have exactly
+   * 2 * LENGTH hexadecimal characters.
+   */
+  Status ParseHexdigest(StringPiece hex);
+
+ private:
+  static const size_t kPrefixLength = LENGTH < 8 ? LENGTH : 8;
+
+  /// The prefix as a big-endian integer, which orders like memcmp().
+  uint64_t ordered_prefix() const {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t value = __builtin_bswap64(prefix());
+#else
+    uint64_t value = prefix();
+#endif
+    return value >> (8 * (8 - kPrefixLength));
+  }
+
+  std::array<uint8_t, L> bytes_;
+};
+
+template <size_t L>
+const size_t Digest<L>::kPrefixLength;
+
+template <size_t L>
+std::string Digest<L>::hexdigest() const {
+  char buffer[LENGTH * 2];
+  hexdigest(buffer);
+  return std::string(buffer, sizeof(buffer));
+}
+
+template <size_t L>
+Status Digest<L>::ParseHexdigest(StringPiece hex) {
+  uint8_t bytes[LENGTH];
+  if (hex.size() != 2 * LENGTH || !HexDecode(hex.data(), LENGTH, bytes)) {
+    return Status(-EINVAL, "Invalid hexadecimal digest: " + hex.as_string());
+  }
+  memcpy(bytes_.data(), bytes, LENGTH);
+  return Status::OK;
+}
+
+}  // namespace vobla
+
+namespace std {
+
+template <size_t L>
+struct hash<vobla::Digest<L>> {
+  size_t operator()(const vobla::Digest<L>& digest) const {
+    return static_cast<size_t>(digest.prefix());
+  }
+};
+
+}  // namespace std
+
+#endif  // VOBLA_DIGEST_H_
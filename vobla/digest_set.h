@@ -0,0 +1,228 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VOBLA_DIGEST_SET_H_
+#define VOBLA_DIGEST_SET_H_
+
+#include <glog/logging.h>
+#include <boost/utility.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "vobla/digest.h"
+
+namespace vobla {
+
+/**
+ * \class ConcurrentDigestSet
+ * \brief A set of digests that many threads can insert into and query.
+ *
+ * Digests are already uniformly distributed, so their leading bytes are
+ * used as the hash directly: the low bits pick one of num_shards() shards
+ * and the following bits a slot in the shard's open-addressed table.
+ *
+ * Insert() locks only its shard. Contains() takes no lock at all: a slot
+ * is filled before its 'full' flag is published with release semantics,
+ * and a grown table is populated before it replaces the old one. Replaced
+ * tables are kept until the set is destroyed, because readers may still
+ * be probing them; they never take more memory than the current tables.
+ *
+ * Digests cannot be removed, which is what a dedup index needs.
+ */
+template <size_t L>
+class ConcurrentDigestSet : boost::noncopyable {
+ public:
+  typedef Digest<L> value_type;
+
+  /**
+   * \brief Constructs an empty set.
+   *
+   * \param expected_size presizes the tables to hold this many digests
+   * without growing.
+   * \param shard_bits the set has 2^shard_bits shards.
+   */
+  explicit ConcurrentDigestSet(size_t expected_size = 0, int shard_bits = 8);
+
+  /**
+   * \brief Inserts a digest.
+   *
+   * \return true if the digest was not in the set before.
+   */
+  bool Insert(const value_type& digest);
+
+  /// Returns true if the digest is in the set. Never blocks.
+  bool Contains(const value_type& digest) const;
+
+  /// Returns the number of digests in the set.
+  size_t size() const;
+
+  int num_shards() const { return 1 << shard_bits_; }
+
+ private:
+  struct Slot {
+    std::atomic<uint8_t> full;
+    value_type digest;
+  };
+
+  struct Table {
+    explicit Table(size_t capacity)
+        : mask(capacity - 1), slots(new Slot[capacity]) {
+      for (size_t i = 0; i <= mask; i++) {
+        slots[i].full.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::atomic<Table*> table;
+    /// Guarded by 'mutex'.
+    size_t size = 0;
+    /// All tables ever used by this shard; the last one is current.
+    std::vector<std::unique_ptr<Table>> tables;
+    /// Keeps shards on separate cache lines.
+    char padding[64];
+  };
+
+  /// Grow a table once it is this full, in percent.
+  static const size_t kMaxLoad = 70;
+
+  static const size_t kMinCapacity = 16;
+
+  uint64_t hash(const value_type& digest) const { return digest.prefix(); }
+
+  Shard& shard_for(uint64_t h) const {
+    return shards_[h & ((1 << shard_bits_) - 1)];
+  }
+
+  size_t first_slot(uint64_t h, const Table& table) const {
+    return (h >> shard_bits_) & table.mask;
+  }
+
+  /// Places a digest known to be absent into 'table'.
+  void Place(Table* table, uint64_t h, const value_type& digest) const;
+
+  /// Doubles the shard's table. Requires the shard lock.
+  void Grow(Shard* shard);
+
+  int shard_bits_;
+
+  std::unique_ptr<Shard[]> shards_;
+};
+
+template <size_t L>
+ConcurrentDigestSet<L>::ConcurrentDigestSet(size_t expected_size,
+                                            int shard_bits)
+    : shard_bits_(shard_bits), shards_(new Shard[1 << shard_bits]) {
+  CHECK_GE(shard_bits, 0);
+  CHECK_LT(shard_bits, 16);
+  size_t per_shard = expected_size / num_shards() * 100 / kMaxLoad + 1;
+  size_t capacity = kMinCapacity;
+  while (capacity < per_shard) {
+    capacity *= 2;
+  }
+  for (int i = 0; i < num_shards(); i++) {
+    shards_[i].tables.emplace_back(new Table(capacity));
+    shards_[i].table.store(shards_[i].tables.back().get(),
+                           std::memory_order_release);
+  }
+}
+
+template <size_t L>
+bool ConcurrentDigestSet<L>::Contains(const value_type& digest) const {
+  const uint64_t h = hash(digest);
+  const Table* table = shard_for(h).table.load(std::memory_order_acquire);
+  for (size_t i = first_slot(h, *table); ; i = (i + 1) & table->mask) {
+    const Slot& slot = table->slots[i];
+    if (!slot.full.load(std::memory_order_acquire)) {
+      return false;
+    }
+    if (slot.digest == digest) {
+      return true;
+    }
+  }
+}
+
+template <size_t L>
+bool ConcurrentDigestSet<L>::Insert(const value_type& digest) {
+  // Duplicates are common in a dedup index; detect them without locking.
+  if (Contains(digest)) {
+    return false;
+  }
+  const uint64_t h = hash(digest);
+  Shard& shard = shard_for(h);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  Table* table = shard.table.load(std::memory_order_relaxed);
+  for (size_t i = first_slot(h, *table); ; i = (i + 1) & table->mask) {
+    Slot& slot = table->slots[i];
+    if (!slot.full.load(std::memory_order_relaxed)) {
+      break;
+    }
+    if (slot.digest == digest) {
+      return false;
+    }
+  }
+  if ((shard.size + 1) * 100 > (table->mask + 1) * kMaxLoad) {
+    Grow(&shard);
+    table = shard.table.load(std::memory_order_relaxed);
+  }
+  Place(table, h, digest);
+  shard.size++;
+  return true;
+}
+
+template <size_t L>
+size_t ConcurrentDigestSet<L>::size() const {
+  size_t total = 0;
+  for (int i = 0; i < num_shards(); i++) {
+    std::lock_guard<std::mutex> lock(shards_[i].mutex);
+    total += shards_[i].size;
+  }
+  return total;
+}
+
+template <size_t L>
+void ConcurrentDigestSet<L>::Place(Table* table, uint64_t h,
+                                   const value_type& digest) const {
+  size_t i = first_slot(h, *table);
+  while (table->slots[i].full.load(std::memory_order_relaxed)) {
+    i = (i + 1) & table->mask;
+  }
+  table->slots[i].digest = digest;
+  table->slots[i].full.store(1, std::memory_order_release);
+}
+
+template <size_t L>
+void ConcurrentDigestSet<L>::Grow(Shard* shard) {
+  const Table* old_table = shard->table.load(std::memory_order_relaxed);
+  std::unique_ptr<Table> table(new Table(2 * (old_table->mask + 1)));
+  for (size_t i = 0; i <= old_table->mask; i++) {
+    const Slot& slot = old_table->slots[i];
+    if (slot.full.load(std::memory_order_relaxed)) {
+      Place(table.get(), hash(slot.digest), slot.digest);
+    }
+  }
+  shard->table.store(table.get(), std::memory_order_release);
+  shard->tables.push_back(std::move(table));
+}
+
+}  // namespace vobla
+
+#endif  // VOBLA_DIGEST_SET_H_
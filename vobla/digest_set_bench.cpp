@@ -0,0 +1,109 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <unordered_set>
+#include "vobla/digest_set.h"
+
+namespace vobla {
+
+namespace {
+
+typedef Digest<20> TestDigest;
+
+/// Derives a uniformly distributed digest from 'i' (splitmix64).
+TestDigest MakeDigest(uint64_t i) {
+  TestDigest digest;
+  for (size_t offset = 0; offset < digest.size(); offset += 8) {
+    uint64_t z = (i += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    memcpy(digest.data() + offset, &z,
+           std::min<size_t>(8, digest.size() - offset));
+  }
+  return digest;
+}
+
+/// Each thread inserts its own digests, so every insert is a new one.
+const uint64_t kThreadStride = 1ULL << 40;
+
+/// The digests looked up by BM_Contains.
+const uint64_t kLookupSetSize = 1 << 20;
+
+ConcurrentDigestSet<20>* insert_set;
+
+void BM_Insert(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    insert_set = new ConcurrentDigestSet<20>;
+  }
+  uint64_t i = state.thread_index() * kThreadStride;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(insert_set->Insert(MakeDigest(i++)));
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    delete insert_set;
+  }
+}
+
+/// Baseline: one std::unordered_set behind one mutex.
+std::unordered_set<TestDigest>* locked_set;
+std::mutex locked_set_mutex;
+
+void BM_LockedSetInsert(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    locked_set = new std::unordered_set<TestDigest>;
+  }
+  uint64_t i = state.thread_index() * kThreadStride;
+  for (auto _ : state) {
+    TestDigest digest = MakeDigest(i++);
+    std::lock_guard<std::mutex> lock(locked_set_mutex);
+    benchmark::DoNotOptimize(locked_set->insert(digest));
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    delete locked_set;
+  }
+}
+
+/// Looks up digests of which half are in the set.
+void BM_Contains(benchmark::State& state) {
+  static ConcurrentDigestSet<20>* lookup_set = [] {
+    auto set = new ConcurrentDigestSet<20>(kLookupSetSize);
+    for (uint64_t i = 0; i < kLookupSetSize; i++) {
+      set->Insert(MakeDigest(i));
+    }
+    return set;
+  }();
+  uint64_t i = state.thread_index() * 7919;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        lookup_set->Contains(MakeDigest(i++ % (2 * kLookupSetSize))));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // anonymous namespace
+
+BENCHMARK(BM_Insert)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_LockedSetInsert)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(BM_Contains)->ThreadRange(1, 64)->UseRealTime();
+
+}  // namespace vobla
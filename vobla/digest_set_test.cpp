@@ -0,0 +1,82 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vobla/digest_set.h"
+#include "vobla/hash.h"
+
+using std::string;
+using std::thread;
+using std::vector;
+
+namespace vobla {
+
+namespace {
+
+typedef ConcurrentDigestSet<SHA1Digest::LENGTH> SHA1DigestSet;
+
+Digest<SHA1Digest::LENGTH> MakeDigest(int i) {
+  return SHA1Hasher::Hash(std::to_string(i));
+}
+
+}  // anonymous namespace
+
+TEST(ConcurrentDigestSetTest, InsertAndContains) {
+  SHA1DigestSet set(0, 2);
+  EXPECT_EQ(4, set.num_shards());
+  EXPECT_FALSE(set.Contains(MakeDigest(0)));
+  // Enough digests to grow every shard several times.
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(set.Insert(MakeDigest(i)));
+  }
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_FALSE(set.Insert(MakeDigest(i)));
+    EXPECT_TRUE(set.Contains(MakeDigest(i)));
+  }
+  EXPECT_FALSE(set.Contains(MakeDigest(1000)));
+  EXPECT_FALSE(set.Contains(Digest<SHA1Digest::LENGTH>()));
+  EXPECT_EQ(1000u, set.size());
+}
+
+TEST(ConcurrentDigestSetTest, ConcurrentInsertsAndLookups) {
+  const int kThreads = 4;
+  const int kDigests = 5000;
+  SHA1DigestSet set;
+  std::atomic<int> inserted(0);
+  vector<thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    // Every thread inserts all digests, so each one races with the others.
+    threads.emplace_back([&] {
+      for (int i = 0; i < kDigests; i++) {
+        if (set.Insert(MakeDigest(i))) {
+          inserted++;
+        }
+        EXPECT_TRUE(set.Contains(MakeDigest(i)));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(kDigests, inserted.load());
+  EXPECT_EQ(static_cast<size_t>(kDigests), set.size());
+}
+
+}  // namespace vobla
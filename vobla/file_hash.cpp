@@ -0,0 +1,146 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "vobla/file_hash.h"
+#include "vobla/timer.h"
+
+using std::deque;
+using std::mutex;
+using std::unique_lock;
+using std::unique_ptr;
+
+namespace vobla {
+
+namespace {
+
+/// Enough to keep the reader one block ahead of the consumer.
+const int kNumBlocks = 2;
+
+struct Block {
+  unique_ptr<char[]> data;
+  size_t size = 0;
+};
+
+/// The blocks handed between the reader and the consumer.
+struct BlockQueue {
+  mutex lock;
+  std::condition_variable cond;
+  /// Blocks ready to be read into.
+  deque<Block*> free;
+  /// Blocks read, in file order.
+  deque<Block*> full;
+  /// Set by the reader after its last block.
+  bool done = false;
+  Status status;
+};
+
+void ReadBlocks(File* file, size_t block_size, BlockQueue* queue) {
+  for (;;) {
+    Block* block;
+    {
+      unique_lock<mutex> lock(queue->lock);
+      queue->cond.wait(lock, [queue] { return !queue->free.empty(); });
+      block = queue->free.front();
+      queue->free.pop_front();
+    }
+    int64 size = file->Read(block->data.get(), block_size);
+    // A short read is either the end of the file or an error.
+    bool last = size < static_cast<int64>(block_size);
+    Status status;
+    if (size < 0 || (last && !file->eof())) {
+      status = Status(-EIO, "Failed to read " + file->CreateFileName());
+      size = 0;
+    }
+    unique_lock<mutex> lock(queue->lock);
+    block->size = size;
+    if (size > 0) {
+      queue->full.push_back(block);
+    } else {
+      queue->free.push_back(block);
+    }
+    if (last) {
+      queue->status = status;
+      queue->done = true;
+    }
+    queue->cond.notify_all();
+    if (last) {
+      return;
+    }
+  }
+}
+
+}  // anonymous namespace
+
+Status ReadFileOverlapped(
+    File* file, const std::function<void(const void*, size_t)>& consume,
+    FileHashStats* stats, size_t block_size) {
+  CHECK(file);
+  CHECK_GT(block_size, 0u);
+  Timer total;
+  CumulatedTimer wait;
+  CumulatedTimer work;
+  uint64_t bytes = 0;
+  total.start();
+
+  Block blocks[kNumBlocks];
+  BlockQueue queue;
+  for (auto& block : blocks) {
+    block.data.reset(new char[block_size]);
+    queue.free.push_back(&block);
+  }
+  std::thread reader(ReadBlocks, file, block_size, &queue);
+  for (;;) {
+    Block* block;
+    {
+      wait.start();
+      unique_lock<mutex> lock(queue.lock);
+      queue.cond.wait(lock, [&queue] {
+        return !queue.full.empty() || queue.done;
+      });
+      wait.stop();
+      if (queue.full.empty()) {
+        break;
+      }
+      block = queue.full.front();
+      queue.full.pop_front();
+    }
+    work.start();
+    consume(block->data.get(), block->size);
+    work.stop();
+    bytes += block->size;
+    unique_lock<mutex> lock(queue.lock);
+    queue.free.push_back(block);
+    queue.cond.notify_all();
+  }
+  reader.join();
+
+  total.stop();
+  if (stats) {
+    stats->bytes = bytes;
+    stats->seconds = total.get_in_second();
+    stats->read_wait_seconds = wait.get_in_second();
+    stats->hash_seconds = work.get_in_second();
+  }
+  return queue.status;
+}
+
+}  // namespace vobla
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file file_hash.h
+ * \brief Hashes files while they are being read.
+ *
+ * A reader thread fills one block while the calling thread hashes the
+ * previous one, so hashing a file takes max(read, hash) time instead of
+ * read + hash, and never holds the whole file in memory.
+ */
+
+#ifndef VOBLA_FILE_HASH_H_
+#define VOBLA_FILE_HASH_H_
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include "vobla/gutil/file.h"
+#include "vobla/status.h"
+
+namespace vobla {
+
+/// Where the time went while reading and hashing one file.
+struct FileHashStats {
+  /// The number of bytes hashed.
+  uint64_t bytes = 0;
+
+  /// The wall time of the whole operation, in seconds.
+  double seconds = 0;
+
+  /// The time the hashing thread waited for the reader, in seconds.
+  double read_wait_seconds = 0;
+
+  /// The time spent hashing, in seconds.
+  double hash_seconds = 0;
+
+  /// Returns the throughput in bytes per second.
+  double throughput() const { return seconds > 0 ? bytes / seconds : 0; }
+};
+
+/// The size of the blocks read by ReadFileOverlapped() by default.
+const size_t kDefaultFileBlockSize = 1 << 20;
+
+/**
+ * \brief Reads 'file' from its current position to the end, overlapping
+ * the reads with processing.
+ *
+ * A reader thread reads blocks of 'block_size' bytes into two buffers.
+ * 'consume' is called on the calling thread for each block in file order
+ * while the next block is being read. The block is only valid during the
+ * call.
+ *
+ * \param stats optional; receives the timings.
+ * \return -EIO if a read fails.
+ */
+Status ReadFileOverlapped(
+    File* file, const std::function<void(const void*, size_t)>& consume,
+    FileHashStats* stats = nullptr,
+    size_t block_size = kDefaultFileBlockSize);
+
+/**
+ * \brief Computes the digest of an open file from its current position.
+ *
+ * 'Digest' is any of the digest classes, e.g. SHA1Digest.
+ */
+template <typename Digest>
+Status HashFile(File* file, Digest* digest, FileHashStats* stats = nullptr) {
+  digest->Init();
+  Status status = ReadFileOverlapped(
+      file, [digest](const void* buffer, size_t size) {
+        digest->Update(buffer, size);
+      }, stats);
+  if (!status.ok()) {
+    return status;
+  }
+  digest->Final();
+  return Status::OK;
+}
+
+/// Computes the digest of the file at 'path'.
+template <typename Digest>
+Status HashFile(const std::string& path, Digest* digest,
+                FileHashStats* stats = nullptr) {
+  File* file = File::Create(path, "r");
+  if (!file->Open()) {
+    int errnum = errno;
+    file->Close();
+    return Status::system_error(errnum);
+  }
+  Status status = HashFile(file, digest, stats);
+  file->Close();
+  return status;
+}
+
+}  // namespace vobla
+
+#endif  // VOBLA_FILE_HASH_H_
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+#include <string>
+#include "vobla/file_hash.h"
+#include "vobla/hash.h"
+
+using std::string;
+
+namespace vobla {
+
+namespace {
+
+const char kPath[] = "/tmp/vobla_file_hash_bench.dat";
+
+/// Writes a file of 'size' bytes, which then stays in the page cache.
+void WriteFile(size_t size) {
+  string content(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    content[i] = static_cast<char>(i * 131);
+  }
+  File* file = File::OpenOrDie(kPath, "w");
+  file->Write(content.data(), content.size());
+  file->Close();
+}
+
+template <typename Digest>
+void BM_HashFile(benchmark::State& state) {
+  WriteFile(state.range(0));
+  FileHashStats stats;
+  for (auto _ : state) {
+    Digest digest;
+    HashFile(kPath, &digest, &stats);
+    benchmark::DoNotOptimize(digest.digest());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  state.counters["read_wait_s"] = stats.read_wait_seconds;
+  state.counters["hash_s"] = stats.hash_seconds;
+  unlink(kPath);
+}
+
+/// The old way: read the whole file into a string, then hash it.
+template <typename Digest>
+void BM_ReadThenHash(benchmark::State& state) {
+  WriteFile(state.range(0));
+  string content(state.range(0), '\0');
+  for (auto _ : state) {
+    File* file = File::OpenOrDie(kPath, "r");
+    file->Read(&content[0], content.size());
+    file->Close();
+    Digest digest(content);
+    benchmark::DoNotOptimize(digest.digest());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  unlink(kPath);
+}
+
+}  // anonymous namespace
+
+BENCHMARK_TEMPLATE(BM_HashFile, SHA1Digest)->Range(1 << 20, 256 << 20)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ReadThenHash, SHA1Digest)->Range(1 << 20, 256 << 20)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HashFile, CRC32CDigest)->Range(1 << 20, 256 << 20)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_ReadThenHash, CRC32CDigest)->Range(1 << 20, 256 << 20)
+    ->UseRealTime();
+
+}  // namespace vobla
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include "vobla/file_hash.h"
+#include "vobla/hash.h"
+
+using std::string;
+
+namespace vobla {
+
+namespace {
+
+class FileHashTest : public testing::Test {
+ protected:
+  void SetUp() {
+    char path[] = "/tmp/vobla_file_hash_test.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    path_ = path;
+  }
+
+  void TearDown() {
+    unlink(path_.c_str());
+  }
+
+  void WriteFile(const string& content) {
+    File* file = File::OpenOrDie(path_, "w");
+    ASSERT_EQ(static_cast<int64>(content.size()),
+              file->Write(content.data(), content.size()));
+    ASSERT_TRUE(file->Close());
+  }
+
+  string path_;
+};
+
+string MakeContent(size_t size) {
+  string content(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    content[i] = static_cast<char>(i * 13 + i / 509);
+  }
+  return content;
+}
+
+}  // anonymous namespace
+
+TEST_F(FileHashTest, MatchesInMemoryDigest) {
+  for (size_t size : {size_t(0), size_t(1000), kDefaultFileBlockSize,
+                      2 * kDefaultFileBlockSize + 17}) {
+    const string content = MakeContent(size);
+    WriteFile(content);
+    SHA1Digest digest;
+    FileHashStats stats;
+    EXPECT_TRUE(HashFile(path_, &digest, &stats).ok());
+    EXPECT_EQ(SHA1Digest(content).hexdigest(), digest.hexdigest());
+    EXPECT_EQ(size, stats.bytes);
+  }
+}
+
+TEST_F(FileHashTest, ReadsBlocksInOrder) {
+  const string content = MakeContent(10007);
+  WriteFile(content);
+  File* file = File::OpenOrDie(path_, "r");
+  string read;
+  EXPECT_TRUE(ReadFileOverlapped(file, [&read](const void* buf, size_t size) {
+    EXPECT_LE(size, 100u);
+    read.append(static_cast<const char*>(buf), size);
+  }, nullptr, 100).ok());
+  file->Close();
+  EXPECT_EQ(content, read);
+}
+
+TEST_F(FileHashTest, MissingFile) {
+  MD5Digest digest;
+  EXPECT_EQ(-ENOENT, HashFile(path_ + ".missing", &digest).error());
+}
+
+}  // namespace vobla
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string>
+#include "vobla/file_util.h"
+
+using std::string;
+
+namespace vobla {
+
+Status WriteStringToFile(const string& path, const string& contents) {
+  FILE* fp = fopen(path.c_str(), "w");
+  if (!fp) {
+    return Status::system_error(errno);
+  }
+  bool written =
+      fwrite(contents.data(), 1, contents.size(), fp) == contents.size();
+  int saved_errno = errno;
+  if (fclose(fp) != 0 || !written) {
+    return Status::system_error(written ? errno : saved_errno);
+  }
+  return Status::OK;
+}
+
+}  // namespace vobla
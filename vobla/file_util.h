@@ -0,0 +1,39 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file file_util.h
+ * \brief Whole-file helpers.
+ */
+
+#ifndef VOBLA_FILE_UTIL_H_
+#define VOBLA_FILE_UTIL_H_
+
+#include <string>
+#include "vobla/status.h"
+
+namespace vobla {
+
+/**
+ * \brief Writes 'contents' to the file 'path', replacing it.
+ *
+ * \return the errno of the failing open, write or close.
+ */
+Status WriteStringToFile(const std::string& path, const std::string& contents);
+
+}  // namespace vobla
+
+#endif  // VOBLA_FILE_UTIL_H_
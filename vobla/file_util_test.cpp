@@ -0,0 +1,48 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "vobla/file_util.h"
+
+using std::string;
+
+namespace vobla {
+
+TEST(FileUtilTest, WriteStringToFile) {
+  char path[] = "/tmp/vobla_file_util_test.XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  const string contents("line\n\0binary", 12);
+  ASSERT_TRUE(WriteStringToFile(path, contents).ok());
+  // Rewriting replaces the contents.
+  ASSERT_TRUE(WriteStringToFile(path, contents).ok());
+  std::ifstream file(path);
+  std::stringstream read;
+  read << file.rdbuf();
+  EXPECT_EQ(contents, read.str());
+  unlink(path);
+
+  EXPECT_EQ(-ENOENT,
+            WriteStringToFile("/nonexistent/vobla/file", contents).error());
+}
+
+}  // namespace vobla
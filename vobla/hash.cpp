@@ -15,20 +15,205 @@
  */
 
 #include <glog/logging.h>
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <memory>
 #include <string>
+#include <vector>
 #include "vobla/hash.h"
+#include "vobla/hash_internal.h"
 
 using std::string;
 using std::unique_ptr;
+using std::vector;
 
 namespace vobla {
 
+using hash_internal::CompressBackend;
+using hash_internal::CompressFunc;
+
+namespace {
+
+// Below these batch sizes, hashing each buffer on its own is as fast as
+// running the 8-lane kernel with idle lanes.
+const size_t kMinMD5Batch = 2;
+const size_t kMinSHA1Batch = 4;
+
+const size_t kBlockSize = 64;
+
+/// The active backend of one algorithm, chosen from its backends.
+class BackendSelector {
+ public:
+  explicit BackendSelector(const vector<CompressBackend>& backends)
+      : backends_(backends), active_(&backends.front()) {
+  }
+
+  const CompressBackend& active() const {
+    return *active_.load(std::memory_order_relaxed);
+  }
+
+  vector<string> names() const {
+    vector<string> names;
+    for (const auto& backend : backends_) {
+      names.push_back(backend.name);
+    }
+    return names;
+  }
+
+  Status Select(StringPiece name) {
+    for (const auto& backend : backends_) {
+      if (name == backend.name) {
+        active_.store(&backend, std::memory_order_relaxed);
+        return Status::OK;
+      }
+    }
+    return Status(-EINVAL, "Unknown hash backend: " + name.as_string());
+  }
+
+ private:
+  const vector<CompressBackend>& backends_;
+
+  std::atomic<const CompressBackend*> active_;
+};
+
+BackendSelector& MD5Backend() {
+  static BackendSelector selector(hash_internal::MD5Backends());
+  return selector;
+}
+
+BackendSelector& SHA1Backend() {
+  static BackendSelector selector(hash_internal::SHA1Backends());
+  return selector;
+}
+
+BackendSelector& SHA256Backend() {
+  static BackendSelector selector(hash_internal::SHA256Backends());
+  return selector;
+}
+
+template <int kWords>
+void BlockInit(BlockHashContext<kWords>* ctx, const uint32_t* iv) {
+  std::copy(iv, iv + kWords, ctx->state);
+  ctx->length = 0;
+}
+
+template <int kWords>
+void BlockUpdate(BlockHashContext<kWords>* ctx, const void* buffer,
+                 size_t size, CompressFunc compress) {
+  if (size == 0) {
+    return;
+  }
+  const uint8_t* data = static_cast<const uint8_t*>(buffer);
+  size_t buffered = ctx->length % kBlockSize;
+  ctx->length += size;
+  if (buffered) {
+    size_t n = std::min(kBlockSize - buffered, size);
+    memcpy(ctx->buffer + buffered, data, n);
+    data += n;
+    size -= n;
+    if (buffered + n < kBlockSize) {
+      return;
+    }
+    compress(ctx->state, ctx->buffer, 1);
+  }
+  // Whole blocks are compressed in place.
+  size_t blocks = size / kBlockSize;
+  if (blocks) {
+    compress(ctx->state, data, blocks);
+  }
+  memcpy(ctx->buffer, data + blocks * kBlockSize, size % kBlockSize);
+}
+
+/// Pads the message and writes the state words in the given byte order.
+template <int kWords>
+void BlockFinal(BlockHashContext<kWords>* ctx, bool big_endian,
+                CompressFunc compress, unsigned char* out) {
+  size_t buffered = ctx->length % kBlockSize;
+  uint64_t bits = ctx->length * 8;
+  ctx->buffer[buffered++] = 0x80;
+  if (buffered > kBlockSize - 8) {
+    memset(ctx->buffer + buffered, 0, kBlockSize - buffered);
+    compress(ctx->state, ctx->buffer, 1);
+    buffered = 0;
+  }
+  memset(ctx->buffer + buffered, 0, kBlockSize - 8 - buffered);
+  for (int i = 0; i < 8; i++) {
+    int shift = big_endian ? 56 - 8 * i : 8 * i;
+    ctx->buffer[kBlockSize - 8 + i] = static_cast<unsigned char>(bits >> shift);
+  }
+  compress(ctx->state, ctx->buffer, 1);
+  for (int w = 0; w < kWords; w++) {
+    for (int i = 0; i < 4; i++) {
+      int shift = big_endian ? 24 - 8 * i : 8 * i;
+      out[4 * w + i] = static_cast<unsigned char>(ctx->state[w] >> shift);
+    }
+  }
+}
+
+}  // anonymous namespace
+
+//----------- MD5 -----------------
+// static
+void MD5Policy::Init(Context* ctx) {
+  BlockInit(ctx, hash_internal::kMD5IV);
+}
+
+// static
+void MD5Policy::Update(Context* ctx, const void* buffer, size_t size) {
+  BlockUpdate(ctx, buffer, size, MD5Backend().active().compress);
+}
+
+// static
+void MD5Policy::Final(Context* ctx, unsigned char* out) {
+  BlockFinal(ctx, false, MD5Backend().active().compress, out);
+}
+
+// static
+const char* MD5Policy::backend() {
+  return MD5Backend().active().name;
+}
+
+// static
+vector<string> MD5Policy::backends() {
+  return MD5Backend().names();
+}
+
+// static
+Status MD5Policy::SetBackend(StringPiece name) {
+  return MD5Backend().Select(name);
+}
+
+// static
+void MD5Digest::ResetBatch(const StringPiece* buffers, size_t n,
+                           MD5Digest* digests) {
+  if (n >= kMinMD5Batch && hash_internal::HasMultiBufferKernel()) {
+    hash_internal::MD5MultiBuffer(buffers, n, digests[0].digest_.data(),
+                                  sizeof(MD5Digest));
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    digests[i].Reset(buffers[i]);
+  }
+}
+
+// static
+void MD5Digest::ResetBatch(const StringPiece* buffers, size_t n,
+                           Digest<16>* digests) {
+  if (n >= kMinMD5Batch && hash_internal::HasMultiBufferKernel()) {
+    hash_internal::MD5MultiBuffer(buffers, n, digests[0].data(),
+                                  sizeof(Digest<16>));
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    digests[i] = Hasher<MD5Policy>::Hash(buffers[i]);
+  }
+}
+
 MD5Digest::MD5Digest() {
 }
 
-MD5Digest::MD5Digest(const string &buffer) {
+MD5Digest::MD5Digest(StringPiece buffer) {
   Init();
   Update(buffer);
   Final();
@@ -38,23 +223,78 @@ MD5Digest::~MD5Digest() {
 }
 
 void MD5Digest::Init() {
-  MD5_Init(&context_);
+  MD5Policy::Init(&context_);
 }
 
-void MD5Digest::Update(const string &buffer) {
-  CHECK(!buffer.empty());
-  MD5_Update(&context_, buffer.data(), buffer.size());
+void MD5Digest::Update(const void* buffer, size_t size) {
+  MD5Policy::Update(&context_, buffer, size);
 }
 
 void MD5Digest::Final() {
-  MD5_Final(digest_.data(), &context_);
+  MD5Policy::Final(&context_, digest_.data());
 }
 
 //----------- SHA-1 -----------------
+// static
+void SHA1Policy::Init(Context* ctx) {
+  BlockInit(ctx, hash_internal::kSHA1IV);
+}
+
+// static
+void SHA1Policy::Update(Context* ctx, const void* buffer, size_t size) {
+  BlockUpdate(ctx, buffer, size, SHA1Backend().active().compress);
+}
+
+// static
+void SHA1Policy::Final(Context* ctx, unsigned char* out) {
+  BlockFinal(ctx, true, SHA1Backend().active().compress, out);
+}
+
+// static
+const char* SHA1Policy::backend() {
+  return SHA1Backend().active().name;
+}
+
+// static
+vector<string> SHA1Policy::backends() {
+  return SHA1Backend().names();
+}
+
+// static
+Status SHA1Policy::SetBackend(StringPiece name) {
+  return SHA1Backend().Select(name);
+}
+
+// static
+void SHA1Digest::ResetBatch(const StringPiece* buffers, size_t n,
+                            SHA1Digest* digests) {
+  if (n >= kMinSHA1Batch && hash_internal::HasMultiBufferKernel()) {
+    hash_internal::SHA1MultiBuffer(buffers, n, digests[0].digest_.data(),
+                                   sizeof(SHA1Digest));
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    digests[i].Reset(buffers[i]);
+  }
+}
+
+// static
+void SHA1Digest::ResetBatch(const StringPiece* buffers, size_t n,
+                            Digest<20>* digests) {
+  if (n >= kMinSHA1Batch && hash_internal::HasMultiBufferKernel()) {
+    hash_internal::SHA1MultiBuffer(buffers, n, digests[0].data(),
+                                   sizeof(Digest<20>));
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    digests[i] = Hasher<SHA1Policy>::Hash(buffers[i]);
+  }
+}
+
 SHA1Digest::SHA1Digest() {
 }
 
-SHA1Digest::SHA1Digest(const string& buffer) {
+SHA1Digest::SHA1Digest(StringPiece buffer) {
   Init();
   Update(buffer);
   Final();
@@ -64,16 +304,428 @@ SHA1Digest::~SHA1Digest() {
 }
 
 void SHA1Digest::Init() {
-  SHA1_Init(&context_);
+  SHA1Policy::Init(&context_);
 }
 
-void SHA1Digest::Update(const string& buffer) {
-  CHECK(!buffer.empty());
-  SHA1_Update(&context_, buffer.data(), buffer.size());
+void SHA1Digest::Update(const void* buffer, size_t size) {
+  SHA1Policy::Update(&context_, buffer, size);
 }
 
 void SHA1Digest::Final() {
-  SHA1_Final(digest_.data(), &context_);
+  SHA1Policy::Final(&context_, digest_.data());
+}
+
+//----------- SHA-256 -----------------
+// static
+void SHA256Policy::Init(Context* ctx) {
+  BlockInit(ctx, hash_internal::kSHA256IV);
+}
+
+// static
+void SHA256Policy::Update(Context* ctx, const void* buffer, size_t size) {
+  BlockUpdate(ctx, buffer, size, SHA256Backend().active().compress);
+}
+
+// static
+void SHA256Policy::Final(Context* ctx, unsigned char* out) {
+  BlockFinal(ctx, true, SHA256Backend().active().compress, out);
+}
+
+// static
+const char* SHA256Policy::backend() {
+  return SHA256Backend().active().name;
+}
+
+// static
+vector<string> SHA256Policy::backends() {
+  return SHA256Backend().names();
+}
+
+// static
+Status SHA256Policy::SetBackend(StringPiece name) {
+  return SHA256Backend().Select(name);
+}
+
+SHA256Digest::SHA256Digest() {
+}
+
+SHA256Digest::SHA256Digest(StringPiece buffer) {
+  Init();
+  Update(buffer);
+  Final();
+}
+
+SHA256Digest::~SHA256Digest() {
+}
+
+void SHA256Digest::Init() {
+  SHA256Policy::Init(&context_);
+}
+
+void SHA256Digest::Update(const void* buffer, size_t size) {
+  SHA256Policy::Update(&context_, buffer, size);
+}
+
+void SHA256Digest::Final() {
+  SHA256Policy::Final(&context_, digest_.data());
+}
+
+//----------- BLAKE3 -----------------
+// static
+void BLAKE3Policy::Init(Context* ctx) {
+  hash_internal::Blake3Init(ctx);
+}
+
+// static
+void BLAKE3Policy::Update(Context* ctx, const void* buffer, size_t size) {
+  hash_internal::Blake3Update(ctx, buffer, size);
+}
+
+// static
+void BLAKE3Policy::Final(Context* ctx, unsigned char* out) {
+  hash_internal::Blake3Final(*ctx, out);
+}
+
+BLAKE3Digest::BLAKE3Digest() {
+}
+
+BLAKE3Digest::BLAKE3Digest(StringPiece buffer) {
+  Init();
+  Update(buffer);
+  Final();
+}
+
+BLAKE3Digest::BLAKE3Digest(ThreadPool* pool) : pool_(pool) {
+}
+
+BLAKE3Digest::~BLAKE3Digest() {
+}
+
+void BLAKE3Digest::Init() {
+  BLAKE3Policy::Init(&context_);
+}
+
+void BLAKE3Digest::Update(const void* buffer, size_t size) {
+  if (pool_) {
+    hash_internal::Blake3UpdateParallel(&context_, buffer, size, pool_);
+  } else {
+    BLAKE3Policy::Update(&context_, buffer, size);
+  }
+}
+
+void BLAKE3Digest::Final() {
+  BLAKE3Policy::Final(&context_, digest_.data());
+}
+
+//----------- CRC32C -----------------
+namespace {
+
+/// Stores 'value' into 'out' in big-endian byte order.
+template <typename T>
+void StoreBigEndian(T value, unsigned char* out) {
+  for (size_t i = 0; i < sizeof(T); i++) {
+    out[i] = static_cast<unsigned char>(value >> (8 * (sizeof(T) - 1 - i)));
+  }
+}
+
+template <typename T>
+T LoadBigEndian(const unsigned char* in) {
+  T value = 0;
+  for (size_t i = 0; i < sizeof(T); i++) {
+    value = (value << 8) | in[i];
+  }
+  return value;
+}
+
+}  // anonymous namespace
+
+// static
+void CRC32CPolicy::Update(Context* ctx, const void* buffer, size_t size) {
+  *ctx = hash_internal::Crc32cExtend(*ctx, buffer, size);
+}
+
+// static
+void CRC32CPolicy::Final(Context* ctx, unsigned char* out) {
+  StoreBigEndian(*ctx, out);
+}
+
+CRC32CDigest::CRC32CDigest() {
+}
+
+CRC32CDigest::CRC32CDigest(StringPiece buffer) {
+  Init();
+  Update(buffer);
+  Final();
+}
+
+CRC32CDigest::~CRC32CDigest() {
+}
+
+void CRC32CDigest::Init() {
+  CRC32CPolicy::Init(&context_);
+}
+
+void CRC32CDigest::Update(const void* buffer, size_t size) {
+  CRC32CPolicy::Update(&context_, buffer, size);
+}
+
+void CRC32CDigest::Final() {
+  CRC32CPolicy::Final(&context_, digest_.data());
+}
+
+uint32_t CRC32CDigest::checksum() const {
+  return LoadBigEndian<uint32_t>(digest_.data());
+}
+
+//----------- xxHash64 -----------------
+// static
+void XXHash64Policy::Init(Context* ctx) {
+  hash_internal::XXHash64Init(ctx, 0);
+}
+
+// static
+void XXHash64Policy::Update(Context* ctx, const void* buffer, size_t size) {
+  if (size) {
+    hash_internal::XXHash64Update(ctx, buffer, size);
+  }
+}
+
+// static
+void XXHash64Policy::Final(Context* ctx, unsigned char* out) {
+  StoreBigEndian(hash_internal::XXHash64Final(*ctx), out);
+}
+
+XXHash64Digest::XXHash64Digest() {
+}
+
+XXHash64Digest::XXHash64Digest(StringPiece buffer) {
+  Init();
+  Update(buffer);
+  Final();
+}
+
+XXHash64Digest::~XXHash64Digest() {
+}
+
+void XXHash64Digest::Init() {
+  XXHash64Policy::Init(&context_);
+}
+
+void XXHash64Digest::Update(const void* buffer, size_t size) {
+  XXHash64Policy::Update(&context_, buffer, size);
+}
+
+void XXHash64Digest::Final() {
+  XXHash64Policy::Final(&context_, digest_.data());
+}
+
+uint64_t XXHash64Digest::checksum() const {
+  return LoadBigEndian<uint64_t>(digest_.data());
+}
+
+//----------- Snapshots -----------------
+namespace {
+
+/// Bumped whenever the layout of a snapshot changes.
+const uint8_t kSnapshotVersion = 1;
+
+/// Identifies the algorithm of a snapshot.
+template <typename Context>
+struct SnapshotTag;
+
+template <> struct SnapshotTag<MD5Context> { enum { value = 1 }; };
+template <> struct SnapshotTag<SHA1Context> { enum { value = 2 }; };
+template <> struct SnapshotTag<SHA256Context> { enum { value = 3 }; };
+template <> struct SnapshotTag<BLAKE3Context> { enum { value = 4 }; };
+template <> struct SnapshotTag<uint32_t> { enum { value = 5 }; };
+template <> struct SnapshotTag<XXHash64Context> { enum { value = 6 }; };
+
+/// Appends little-endian integers and raw bytes to a snapshot.
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(string* out) : out_(out) {}
+
+  template <typename T>
+  void Put(T value) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+      out_->push_back(static_cast<char>(value >> (8 * i)));
+    }
+  }
+
+  void PutBytes(const void* data, size_t size) {
+    out_->append(static_cast<const char*>(data), size);
+  }
+
+ private:
+  string* out_;
+};
+
+/// Reads what SnapshotWriter wrote. Every Get fails once input runs out.
+class SnapshotReader {
+ public:
+  explicit SnapshotReader(StringPiece in) : in_(in) {}
+
+  template <typename T>
+  bool Get(T* value) {
+    if (static_cast<size_t>(in_.size()) < sizeof(T)) {
+      return false;
+    }
+    T result = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      result |= static_cast<T>(static_cast<uint8_t>(in_[i])) << (8 * i);
+    }
+    *value = result;
+    in_.remove_prefix(sizeof(T));
+    return true;
+  }
+
+  bool GetBytes(void* data, size_t size) {
+    if (static_cast<size_t>(in_.size()) < size) {
+      return false;
+    }
+    memcpy(data, in_.data(), size);
+    in_.remove_prefix(size);
+    return true;
+  }
+
+  bool empty() const { return in_.empty(); }
+
+ private:
+  StringPiece in_;
+};
+
+// Only the buffered input is saved, since the rest of each buffer is unused.
+
+template <int kWords>
+void Encode(const BlockHashContext<kWords>& ctx, SnapshotWriter* writer) {
+  for (int i = 0; i < kWords; i++) {
+    writer->Put(ctx.state[i]);
+  }
+  writer->Put(ctx.length);
+  writer->PutBytes(ctx.buffer, ctx.length % kBlockSize);
+}
+
+template <int kWords>
+bool Decode(SnapshotReader* reader, BlockHashContext<kWords>* ctx) {
+  for (int i = 0; i < kWords; i++) {
+    if (!reader->Get(&ctx->state[i])) {
+      return false;
+    }
+  }
+  return reader->Get(&ctx->length) &&
+      reader->GetBytes(ctx->buffer, ctx->length % kBlockSize);
+}
+
+void Encode(const BLAKE3Context& ctx, SnapshotWriter* writer) {
+  for (uint32_t word : ctx.chunk_cv) {
+    writer->Put(word);
+  }
+  writer->Put(ctx.chunk_counter);
+  writer->Put(ctx.blocks_compressed);
+  writer->Put(ctx.block_len);
+  writer->PutBytes(ctx.block, ctx.block_len);
+  writer->Put(ctx.cv_stack_len);
+  for (int i = 0; i < ctx.cv_stack_len; i++) {
+    for (uint32_t word : ctx.cv_stack[i]) {
+      writer->Put(word);
+    }
+  }
+}
+
+bool Decode(SnapshotReader* reader, BLAKE3Context* ctx) {
+  for (uint32_t& word : ctx->chunk_cv) {
+    if (!reader->Get(&word)) {
+      return false;
+    }
+  }
+  if (!reader->Get(&ctx->chunk_counter) ||
+      !reader->Get(&ctx->blocks_compressed) || !reader->Get(&ctx->block_len) ||
+      ctx->block_len > sizeof(ctx->block) ||
+      ctx->blocks_compressed * sizeof(ctx->block) + ctx->block_len > 1024 ||
+      !reader->GetBytes(ctx->block, ctx->block_len) ||
+      !reader->Get(&ctx->cv_stack_len) ||
+      ctx->cv_stack_len > sizeof(ctx->cv_stack) / sizeof(ctx->cv_stack[0]) ||
+      // The stack holds one subtree per set bit of the chunk counter.
+      ctx->cv_stack_len != __builtin_popcountll(ctx->chunk_counter)) {
+    return false;
+  }
+  for (int i = 0; i < ctx->cv_stack_len; i++) {
+    for (uint32_t& word : ctx->cv_stack[i]) {
+      if (!reader->Get(&word)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void Encode(uint32_t crc, SnapshotWriter* writer) {
+  writer->Put(crc);
+}
+
+bool Decode(SnapshotReader* reader, uint32_t* crc) {
+  return reader->Get(crc);
+}
+
+void Encode(const XXHash64Context& ctx, SnapshotWriter* writer) {
+  writer->Put(ctx.total_length);
+  writer->Put(ctx.seed);
+  for (uint64_t v : ctx.v) {
+    writer->Put(v);
+  }
+  writer->PutBytes(ctx.buffer, ctx.buffered);
+}
+
+bool Decode(SnapshotReader* reader, XXHash64Context* ctx) {
+  if (!reader->Get(&ctx->total_length) || !reader->Get(&ctx->seed)) {
+    return false;
+  }
+  for (uint64_t& v : ctx->v) {
+    if (!reader->Get(&v)) {
+      return false;
+    }
+  }
+  ctx->buffered = ctx->total_length % sizeof(ctx->buffer);
+  return reader->GetBytes(ctx->buffer, ctx->buffered);
+}
+
+}  // anonymous namespace
+
+template <typename Context>
+void SaveHashContext(const Context& ctx, string* out) {
+  SnapshotWriter writer(out);
+  writer.Put(kSnapshotVersion);
+  writer.Put(static_cast<uint8_t>(SnapshotTag<Context>::value));
+  Encode(ctx, &writer);
+}
+
+template <typename Context>
+Status LoadHashContext(StringPiece snapshot, Context* ctx) {
+  SnapshotReader reader(snapshot);
+  uint8_t version = 0;
+  uint8_t tag = 0;
+  Context restored;
+  if (!reader.Get(&version) || version != kSnapshotVersion ||
+      !reader.Get(&tag) || tag != SnapshotTag<Context>::value ||
+      !Decode(&reader, &restored) || !reader.empty()) {
+    return Status(-EINVAL, "Invalid hash snapshot");
+  }
+  *ctx = restored;
+  return Status::OK;
 }
 
+template void SaveHashContext(const MD5Context&, string*);
+template void SaveHashContext(const SHA1Context&, string*);
+template void SaveHashContext(const SHA256Context&, string*);
+template void SaveHashContext(const BLAKE3Context&, string*);
+template void SaveHashContext(const uint32_t&, string*);
+template void SaveHashContext(const XXHash64Context&, string*);
+
+template Status LoadHashContext(StringPiece, MD5Context*);
+template Status LoadHashContext(StringPiece, SHA1Context*);
+template Status LoadHashContext(StringPiece, SHA256Context*);
+template Status LoadHashContext(StringPiece, BLAKE3Context*);
+template Status LoadHashContext(StringPiece, uint32_t*);
+template Status LoadHashContext(StringPiece, XXHash64Context*);
+
 }  // namespace vobla
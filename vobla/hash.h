@@ -17,18 +17,16 @@
 #ifndef VOBLA_HASH_H_
 #define VOBLA_HASH_H_
 
-#if defined(__APPLE__) && defined(__MACH__)
-  #define COMMON_DIGEST_FOR_OPENSSL
-  #include <CommonCrypto/CommonDigest.h>
-  #define SHA1 CC_SHA1
-#else
-#include <openssl/md5.h>
-#include <openssl/sha.h>
-#endif
-
+#include <stdint.h>
+#include <string.h>
 #include <array>
 #include <memory>
 #include <string>
+#include <vector>
+#include "vobla/digest.h"
+#include "vobla/gutil/strings/stringpiece.h"
+#include "vobla/hex.h"
+#include "vobla/status.h"
 
 namespace vobla {
 
@@ -64,13 +62,28 @@ class BaseHashDigest {
   }
 
   /// Resets the value of this hash from the new content.
-  virtual void Reset(const std::string& buffer);
+  virtual void Reset(const void* buffer, size_t size);
+
+  /// Resets the value of this hash from the new content.
+  void Reset(StringPiece buffer) {
+    Reset(buffer.data(), buffer.size());
+  }
 
   /// Initial this digest for feeding data.
   virtual void Init() = 0;
 
-  /// Feeds data to this hash digest.
-  virtual void Update(const std::string& buffer) = 0;
+  /**
+   * \brief Feeds data to this hash digest.
+   *
+   * The buffer is hashed in place and is not retained after the call
+   * returns. An empty buffer is a no-op.
+   */
+  virtual void Update(const void* buffer, size_t size) = 0;
+
+  /// Feeds data to this hash digest. Accepts std::string and C strings.
+  void Update(StringPiece buffer) {
+    Update(buffer.data(), buffer.size());
+  }
 
   /// Finalize the data feeding process.
   virtual void Final() = 0;
@@ -78,11 +91,41 @@ class BaseHashDigest {
   /// get underlay digest array.
   const unsigned char* digest() const { return digest_.data(); }
 
+  /// Returns the digest as a compact value, without the hashing context.
+  Digest<L> value() const { return Digest<L>(digest_.data()); }
+
   /// return the hexadecimal digest.
   std::string hexdigest() const;
 
-  /// parse the digest from a hexadecimal format string
-  void ParseHexdigest(const std::string& hash_str);
+  /// Writes the 2 * LENGTH hexadecimal characters to 'out', without a NUL.
+  void hexdigest(char* out) const { HexEncode(digest_.data(), LENGTH, out); }
+
+  /**
+   * \brief parse the digest from a hexadecimal format string.
+   *
+   * The digest is left unchanged if 'hash_str' does not have exactly
+   * 2 * LENGTH hexadecimal characters.
+   */
+  Status ParseHexdigest(StringPiece hash_str);
+
+  /**
+   * \brief Returns the hashing state between Init() and Final() in a
+   * compact byte form.
+   *
+   * A digest that Restore()s the snapshot, possibly in another process, and
+   * is then fed the rest of the input ends with the same digest. A long
+   * upload can thus resume hashing from its last checkpoint after a restart.
+   */
+  std::string Snapshot() const;
+
+  /**
+   * \brief Restores the hashing state saved by Snapshot(), in place of
+   * Init().
+   *
+   * \return -EINVAL, leaving the state unchanged, if 'snapshot' is corrupt
+   * or was taken from another algorithm.
+   */
+  Status Restore(StringPiece snapshot);
 
  protected:
   // Disallow to create base digest directly.
@@ -95,29 +138,110 @@ class BaseHashDigest {
   Context context_;
 };
 
+/**
+ * \brief The in-progress state of MD5, SHA-1 and SHA-256, which compress
+ * 64-byte blocks into 'kWords' 32-bit words.
+ */
+template <int kWords>
+struct BlockHashContext {
+  uint32_t state[kWords];
+  /// The number of bytes hashed so far.
+  uint64_t length;
+  /// Input not yet consumed by a full block.
+  unsigned char buffer[64];
+};
+
+typedef BlockHashContext<4> MD5Context;
+
+typedef BlockHashContext<5> SHA1Context;
+
+typedef BlockHashContext<8> SHA256Context;
+
+/**
+ * \brief The in-progress state of a BLAKE3Digest.
+ *
+ * Input is split into 1 KB chunks, the leaves of a binary tree. 'cv_stack'
+ * holds the chaining values of the complete subtrees to the left of the
+ * current chunk, one per set bit of 'chunk_counter'.
+ */
+struct BLAKE3Context {
+  /// The chaining value of the current chunk.
+  uint32_t chunk_cv[8];
+  /// The index of the current chunk.
+  uint64_t chunk_counter;
+  /// The current 64-byte block of the chunk, not yet compressed.
+  unsigned char block[64];
+  uint8_t block_len;
+  /// The number of blocks of the current chunk compressed so far.
+  uint8_t blocks_compressed;
+  uint8_t cv_stack_len;
+  uint32_t cv_stack[54][8];
+};
+
+class ThreadPool;
+
+/**
+ * \brief Appends the snapshot of an in-progress hashing context to 'out'.
+ *
+ * Defined for the contexts of the digests in this file. The snapshot holds
+ * a format version, the algorithm, the state words and the input not yet
+ * consumed by a full block, all in little-endian byte order; a SHA-1
+ * snapshot takes at most 93 bytes.
+ */
+template <typename Context>
+void SaveHashContext(const Context& ctx, std::string* out);
+
+/**
+ * \brief Restores a context saved by SaveHashContext().
+ *
+ * \return -EINVAL, leaving 'ctx' unchanged, if 'snapshot' is not a valid
+ * snapshot of this kind of context.
+ */
+template <typename Context>
+Status LoadHashContext(StringPiece snapshot, Context* ctx);
+
 /**
  * \class MD5Digest
  * \brief MD5 digest.
+ *
+ * The compression function runs on the backend chosen by MD5Policy.
  */
-class MD5Digest : public BaseHashDigest<MD5_CTX, 16> {
+class MD5Digest : public BaseHashDigest<MD5Context, 16> {
  public:
+  using BaseHashDigest::Update;
+
   // Factory methods
   /// Creates a MD5Digest from a string.
-  static MD5Digest* create(const std::string& buffer);
+  static MD5Digest* create(StringPiece buffer);
+
+  /**
+   * \brief Hashes 'n' independent buffers, storing the digest of buffers[i]
+   * into digests[i].
+   *
+   * On CPUs with AVX2 the buffers are interleaved through an 8-lane
+   * multi-buffer kernel, which is much faster than calling Reset() on each
+   * buffer when hashing many small chunks.
+   */
+  static void ResetBatch(const StringPiece* buffers, size_t n,
+                         MD5Digest* digests);
+
+  /// Same as above, but stores compact digest values.
+  static void ResetBatch(const StringPiece* buffers, size_t n,
+                         Digest<16>* digests);
 
   /// Constructs an empty MD5Digest.
   MD5Digest();
 
   /// Constructs a MD5Digest from a string.
-  explicit MD5Digest(const std::string& buffer);
+  explicit MD5Digest(StringPiece buffer);
 
   ~MD5Digest();
 
-  /// Initializes a SHA1Digest update.
+  /// Initializes a MD5Digest update.
   void Init();
 
   /// Updates the content.
-  void Update(const std::string& buf);
+  void Update(const void* buffer, size_t size);
 
   /**
    * \brief Finalizes the MD5Digest content generation and move the MD5 value
@@ -129,18 +253,37 @@ class MD5Digest : public BaseHashDigest<MD5_CTX, 16> {
 /**
  * \class SHA1Digest
  * \brief SHA1 digest.
+ *
+ * The compression function runs on the backend chosen by SHA1Policy.
  */
-class SHA1Digest : public BaseHashDigest<SHA_CTX, 20> {
+class SHA1Digest : public BaseHashDigest<SHA1Context, 20> {
  public:
+  using BaseHashDigest::Update;
+
   // Factory methods
   /// Creates a SHA1Digest from a string.
-  static SHA1Digest* create(const std::string &buffer);
+  static SHA1Digest* create(StringPiece buffer);
+
+  /**
+   * \brief Hashes 'n' independent buffers, storing the digest of buffers[i]
+   * into digests[i].
+   *
+   * On CPUs with AVX2 the buffers are interleaved through an 8-lane
+   * multi-buffer kernel, which is much faster than calling Reset() on each
+   * buffer when hashing many small chunks.
+   */
+  static void ResetBatch(const StringPiece* buffers, size_t n,
+                         SHA1Digest* digests);
+
+  /// Same as above, but stores compact digest values.
+  static void ResetBatch(const StringPiece* buffers, size_t n,
+                         Digest<20>* digests);
 
   /// Constructs an empty SHA1Digest.
   SHA1Digest();
 
   /// Constructs a SHA1Digest from a string.
-  explicit SHA1Digest(const std::string &buffer);
+  explicit SHA1Digest(StringPiece buffer);
 
   ~SHA1Digest();
 
@@ -148,7 +291,7 @@ class SHA1Digest : public BaseHashDigest<SHA_CTX, 20> {
   void Init();
 
   /// Updates the content.
-  void Update(const std::string& buffer);
+  void Update(const void* buffer, size_t size);
 
   /**
    * \brief Finalizes the SHA1Digest content generation and move the SHA1 value
@@ -157,6 +300,346 @@ class SHA1Digest : public BaseHashDigest<SHA_CTX, 20> {
   void Final();
 };
 
+/**
+ * \class SHA256Digest
+ * \brief SHA-256 digest.
+ *
+ * The compression function runs on the backend chosen by SHA256Policy.
+ */
+class SHA256Digest : public BaseHashDigest<SHA256Context, 32> {
+ public:
+  using BaseHashDigest::Update;
+
+  /// Constructs an empty SHA256Digest.
+  SHA256Digest();
+
+  /// Constructs a SHA256Digest from a string.
+  explicit SHA256Digest(StringPiece buffer);
+
+  ~SHA256Digest();
+
+  /// Initializes a SHA256Digest update.
+  void Init();
+
+  /// Updates the content.
+  void Update(const void* buffer, size_t size);
+
+  /// Finalizes the hash and moves it to the digest_ field.
+  void Final();
+};
+
+/**
+ * \class BLAKE3Digest
+ * \brief BLAKE3 digest, 32 bytes long.
+ *
+ * BLAKE3 hashes a message as a binary tree of 1 KB chunks, so independent
+ * subtrees of a large buffer can be hashed on several cores. A digest
+ * constructed with a ThreadPool splits each large Update() across the pool;
+ * the result is the same as hashing serially.
+ */
+class BLAKE3Digest : public BaseHashDigest<BLAKE3Context, 32> {
+ public:
+  using BaseHashDigest::Update;
+
+  /// Constructs an empty BLAKE3Digest hashing on the calling thread.
+  BLAKE3Digest();
+
+  /// Constructs a BLAKE3Digest from a string.
+  explicit BLAKE3Digest(StringPiece buffer);
+
+  /**
+   * \brief Constructs an empty BLAKE3Digest that hashes large updates on
+   * 'pool'.
+   *
+   * Update() waits for the pool's tasks, so it must not be called from a
+   * task running on the same pool.
+   */
+  explicit BLAKE3Digest(ThreadPool* pool);
+
+  ~BLAKE3Digest();
+
+  /// Initializes a BLAKE3Digest update.
+  void Init();
+
+  /// Updates the content.
+  void Update(const void* buffer, size_t size);
+
+  /// Finalizes the hash and moves it to the digest_ field.
+  void Final();
+
+ private:
+  ThreadPool* pool_ = nullptr;
+};
+
+/**
+ * \class CRC32CDigest
+ * \brief CRC-32C (Castagnoli) checksum.
+ *
+ * A fast, non-cryptographic integrity check. It uses the SSE4.2 crc32
+ * instruction with three interleaved streams folded by PCLMUL when the CPU
+ * supports them. The digest holds the CRC in big-endian byte order, so
+ * hexdigest() prints the conventional form, e.g. "e3069283" for "123456789".
+ */
+class CRC32CDigest : public BaseHashDigest<uint32_t, 4> {
+ public:
+  using BaseHashDigest::Update;
+
+  /// Constructs an empty CRC32CDigest.
+  CRC32CDigest();
+
+  /// Constructs a CRC32CDigest from a string.
+  explicit CRC32CDigest(StringPiece buffer);
+
+  ~CRC32CDigest();
+
+  /// Initializes a CRC32CDigest update.
+  void Init();
+
+  /// Updates the content.
+  void Update(const void* buffer, size_t size);
+
+  /// Finalizes the checksum and moves it to the digest_ field.
+  void Final();
+
+  /// Returns the checksum computed by the last Final().
+  uint32_t checksum() const;
+};
+
+/**
+ * \brief The in-progress state of a XXHash64Digest.
+ */
+struct XXHash64Context {
+  uint64_t total_length;
+  uint64_t seed;
+  uint64_t v[4];
+  /// Input not yet consumed by a full 32-byte stripe.
+  unsigned char buffer[32];
+  uint32_t buffered;
+};
+
+/**
+ * \class XXHash64Digest
+ * \brief 64-bit xxHash (XXH64) with seed 0.
+ *
+ * A fast, non-cryptographic hash. The digest holds the hash in big-endian
+ * byte order, which is the canonical form printed by xxhsum.
+ */
+class XXHash64Digest : public BaseHashDigest<XXHash64Context, 8> {
+ public:
+  using BaseHashDigest::Update;
+
+  /// Constructs an empty XXHash64Digest.
+  XXHash64Digest();
+
+  /// Constructs a XXHash64Digest from a string.
+  explicit XXHash64Digest(StringPiece buffer);
+
+  ~XXHash64Digest();
+
+  /// Initializes a XXHash64Digest update.
+  void Init();
+
+  /// Updates the content.
+  void Update(const void* buffer, size_t size);
+
+  /// Finalizes the hash and moves it to the digest_ field.
+  void Final();
+
+  /// Returns the hash computed by the last Final().
+  uint64_t checksum() const;
+};
+
+/**
+ * \brief Hash policies: the algorithm of each digest as static functions.
+ *
+ * A policy provides the Context type, the digest LENGTH and
+ * Init/Update/Final on a Context. It is shared by the virtual digest classes
+ * above and by Hasher below.
+ */
+struct MD5Policy {
+  typedef MD5Context Context;
+  enum { LENGTH = 16 };
+
+  static void Init(Context* ctx);
+
+  static void Update(Context* ctx, const void* buffer, size_t size);
+
+  static void Final(Context* ctx, unsigned char* out);
+
+  /**
+   * \brief Returns the name of the active compression backend.
+   *
+   * The fastest backend this CPU runs is chosen at startup: "openssl"
+   * (OpenSSL's assembly transform) or "portable".
+   */
+  static const char* backend();
+
+  /// Returns the names of the backends this CPU runs, fastest first.
+  static std::vector<std::string> backends();
+
+  /**
+   * \brief Switches all MD5 hashing to another backend, e.g. to compare
+   * them.
+   *
+   * All backends share the Context, so digests in progress stay valid.
+   * \return -EINVAL if 'name' is not one of backends().
+   */
+  static Status SetBackend(StringPiece name);
+};
+
+/**
+ * \brief SHA-1. See MD5Policy.
+ *
+ * The backends are "sha-ni" (the SHA extensions of recent x86 CPUs),
+ * "openssl" and "portable".
+ */
+struct SHA1Policy {
+  typedef SHA1Context Context;
+  enum { LENGTH = 20 };
+
+  static void Init(Context* ctx);
+
+  static void Update(Context* ctx, const void* buffer, size_t size);
+
+  static void Final(Context* ctx, unsigned char* out);
+
+  static const char* backend();
+
+  static std::vector<std::string> backends();
+
+  static Status SetBackend(StringPiece name);
+};
+
+/**
+ * \brief SHA-256. See MD5Policy.
+ *
+ * The backends are "sha-ni", "openssl" and "portable".
+ */
+struct SHA256Policy {
+  typedef SHA256Context Context;
+  enum { LENGTH = 32 };
+
+  static void Init(Context* ctx);
+
+  static void Update(Context* ctx, const void* buffer, size_t size);
+
+  static void Final(Context* ctx, unsigned char* out);
+
+  static const char* backend();
+
+  static std::vector<std::string> backends();
+
+  static Status SetBackend(StringPiece name);
+};
+
+/// BLAKE3, hashing on the calling thread. See MD5Policy.
+struct BLAKE3Policy {
+  typedef BLAKE3Context Context;
+  enum { LENGTH = 32 };
+
+  static void Init(Context* ctx);
+
+  static void Update(Context* ctx, const void* buffer, size_t size);
+
+  static void Final(Context* ctx, unsigned char* out);
+};
+
+/// CRC-32C. See MD5Policy.
+struct CRC32CPolicy {
+  typedef uint32_t Context;
+  enum { LENGTH = 4 };
+
+  static void Init(Context* ctx) { *ctx = 0; }
+
+  static void Update(Context* ctx, const void* buffer, size_t size);
+
+  static void Final(Context* ctx, unsigned char* out);
+};
+
+/// xxHash64. See MD5Policy.
+struct XXHash64Policy {
+  typedef XXHash64Context Context;
+  enum { LENGTH = 8 };
+
+  static void Init(Context* ctx);
+
+  static void Update(Context* ctx, const void* buffer, size_t size);
+
+  static void Final(Context* ctx, unsigned char* out);
+};
+
+/**
+ * \class Hasher
+ * \brief A non-virtual hash digest whose calls resolve at compile time.
+ *
+ * Unlike BaseHashDigest, a Hasher does not keep the digest: Final() returns
+ * it as a value_type, a Digest holding only the bytes, with no vtable or
+ * hashing context. That is the form to store digests in bulk, e.g. a
+ * std::vector of a million SHA1Hasher::value_type takes 20 MB.
+ *
+ * \code{.cpp}
+ * SHA1Hasher hasher;
+ * hasher.Init();
+ * hasher.Update(buffer, size);
+ * SHA1Hasher::value_type digest = hasher.Final();
+ * \endcode
+ */
+template <typename Policy>
+class Hasher {
+ public:
+  enum { LENGTH = Policy::LENGTH };
+
+  typedef Digest<LENGTH> value_type;
+
+  /// Returns the digest of 'buffer'.
+  static value_type Hash(StringPiece buffer) {
+    Hasher hasher;
+    hasher.Init();
+    hasher.Update(buffer);
+    return hasher.Final();
+  }
+
+  /// Initializes the hasher for feeding data.
+  void Init() { Policy::Init(&context_); }
+
+  /// Feeds data to this hasher. An empty buffer is a no-op.
+  void Update(const void* buffer, size_t size) {
+    Policy::Update(&context_, buffer, size);
+  }
+
+  /// Feeds data to this hasher. Accepts std::string and C strings.
+  void Update(StringPiece buffer) { Update(buffer.data(), buffer.size()); }
+
+  /// Finalizes the data feeding process and returns the digest.
+  value_type Final() {
+    value_type digest;
+    Policy::Final(&context_, digest.data());
+    return digest;
+  }
+
+  /// Returns the hashing state. See BaseHashDigest::Snapshot().
+  std::string Snapshot() const {
+    std::string snapshot;
+    SaveHashContext(context_, &snapshot);
+    return snapshot;
+  }
+
+  /// Restores the hashing state. See BaseHashDigest::Restore().
+  Status Restore(StringPiece snapshot) {
+    return LoadHashContext(snapshot, &context_);
+  }
+
+ private:
+  typename Policy::Context context_;
+};
+
+typedef Hasher<MD5Policy> MD5Hasher;
+typedef Hasher<SHA1Policy> SHA1Hasher;
+typedef Hasher<SHA256Policy> SHA256Hasher;
+typedef Hasher<BLAKE3Policy> BLAKE3Hasher;
+typedef Hasher<CRC32CPolicy> CRC32CHasher;
+typedef Hasher<XXHash64Policy> XXHash64Hasher;
+
 template <typename Ctx, size_t L>
 BaseHashDigest<Ctx, L>::BaseHashDigest() {
   digest_.fill(0);
@@ -175,23 +658,37 @@ BaseHashDigest<Ctx, L>& BaseHashDigest<Ctx, L>::operator=(
 }
 
 template <typename Ctx, size_t L>
-void BaseHashDigest<Ctx, L>::Reset(const std::string& buf) {
+void BaseHashDigest<Ctx, L>::Reset(const void* buf, size_t size) {
   Init();
-  Update(buf);
+  Update(buf, size);
   Final();
 }
 
 template <typename Ctx, size_t L>
 std::string BaseHashDigest<Ctx, L>::hexdigest() const {
-  char buffer[LENGTH * 2 + 1];
-  static const char hexval[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
-    '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
-  for (int j = 0; j < LENGTH; j++) {
-    buffer[j*2] = hexval[((digest_[j] >> 4) & 0xF)];
-    buffer[(j*2) + 1] = hexval[(digest_[j]) & 0x0F];
+  return value().hexdigest();
+}
+
+template <typename Ctx, size_t L>
+Status BaseHashDigest<Ctx, L>::ParseHexdigest(StringPiece hash_str) {
+  Digest<L> parsed;
+  Status status = parsed.ParseHexdigest(hash_str);
+  if (status.ok()) {
+    memcpy(digest_.data(), parsed.data(), LENGTH);
   }
-  buffer[LENGTH * 2] = '\0';
-  return buffer;
+  return status;
+}
+
+template <typename Ctx, size_t L>
+std::string BaseHashDigest<Ctx, L>::Snapshot() const {
+  std::string snapshot;
+  SaveHashContext(context_, &snapshot);
+  return snapshot;
+}
+
+template <typename Ctx, size_t L>
+Status BaseHashDigest<Ctx, L>::Restore(StringPiece snapshot) {
+  return LoadHashContext(snapshot, &context_);
 }
 
 }  // namespace vobla
@@ -0,0 +1,476 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file hash_backend.cpp
+ * \brief The implementations of the MD5, SHA-1 and SHA-256 compression
+ * functions.
+ *
+ * Every backend works on the same state words, so a digest in progress
+ * can switch backends at any block boundary.
+ */
+
+#include <string.h>
+#include <vector>
+#include "vobla/hash_internal.h"
+#include "vobla/sysinfo.h"
+
+// CommonCrypto, which stands in for OpenSSL on OS X, has no transforms.
+// OpenSSL 3 deprecates them in favor of EVP, which cannot run a transform
+// on a caller-owned state.
+#if !(defined(__APPLE__) && defined(__MACH__))
+#define VOBLA_HAVE_OPENSSL_TRANSFORM 1
+#define OPENSSL_SUPPRESS_DEPRECATED 1
+#include <openssl/md5.h>
+#include <openssl/sha.h>
+#endif
+
+#if defined(VOBLA_HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+namespace vobla {
+namespace hash_internal {
+
+const uint32_t kMD5IV[4] = {
+  0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476,
+};
+
+const uint32_t kSHA1IV[5] = {
+  0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+};
+
+const uint32_t kSHA256IV[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+const uint32_t kMD5K[64] = {
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+  0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+  0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+  0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+  0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+  0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+  0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+  0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+  0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+  0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+  0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+namespace {
+
+const size_t kBlockSize = 64;
+
+/// The round constants of SHA-256, aligned for vector loads.
+alignas(16) const uint32_t kSHA256K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t Rotl(uint32_t x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+inline uint32_t LoadLittleEndian32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+      static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline uint32_t LoadBigEndian32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 |
+      static_cast<uint32_t>(p[2]) << 8 | static_cast<uint32_t>(p[3]);
+}
+
+// ---- Portable ----
+
+/// Shifts of the MD5 steps: four per round.
+const int kMD5Shift[16] = {
+  7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21,
+};
+
+void MD5CompressPortable(uint32_t* state, const uint8_t* blocks,
+                         size_t num_blocks) {
+  for (; num_blocks > 0; num_blocks--, blocks += kBlockSize) {
+    uint32_t x[16];
+    for (int i = 0; i < 16; i++) {
+      x[i] = LoadLittleEndian32(blocks + 4 * i);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+#pragma GCC unroll 64
+    for (int i = 0; i < 64; i++) {
+      uint32_t f;
+      int g;
+      if (i < 16) {
+        f = d ^ (b & (c ^ d));
+        g = i;
+      } else if (i < 32) {
+        f = c ^ (d & (b ^ c));
+        g = (5 * i + 1) & 15;
+      } else if (i < 48) {
+        f = b ^ c ^ d;
+        g = (3 * i + 5) & 15;
+      } else {
+        f = c ^ (b | ~d);
+        g = (7 * i) & 15;
+      }
+      uint32_t t = d;
+      d = c;
+      c = b;
+      b += Rotl(a + f + kMD5K[i] + x[g], kMD5Shift[(i / 16) * 4 + i % 4]);
+      a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+  }
+}
+
+/**
+ * SHA-1 steps i to i + 4. The message schedule is expanded in place in a
+ * 16-word window.
+ */
+#define SHA1_STEP(f, k, i)                                                  \
+  do {                                                                      \
+    if ((i) >= 16) {                                                        \
+      w[(i) & 15] = Rotl(w[((i) - 3) & 15] ^ w[((i) - 8) & 15] ^            \
+                         w[((i) - 14) & 15] ^ w[(i) & 15], 1);              \
+    }                                                                       \
+    uint32_t t = Rotl(a, 5) + (f) + e + (k) + w[(i) & 15];                  \
+    e = d;                                                                  \
+    d = c;                                                                  \
+    c = Rotl(b, 30);                                                        \
+    b = a;                                                                  \
+    a = t;                                                                  \
+  } while (0)
+
+void SHA1CompressPortable(uint32_t* state, const uint8_t* blocks,
+                          size_t num_blocks) {
+  for (; num_blocks > 0; num_blocks--, blocks += kBlockSize) {
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+      w[i] = LoadBigEndian32(blocks + 4 * i);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+        e = state[4];
+#pragma GCC unroll 20
+    for (int i = 0; i < 20; i++) {
+      SHA1_STEP(d ^ (b & (c ^ d)), 0x5a827999, i);
+    }
+#pragma GCC unroll 20
+    for (int i = 20; i < 40; i++) {
+      SHA1_STEP(b ^ c ^ d, 0x6ed9eba1, i);
+    }
+#pragma GCC unroll 20
+    for (int i = 40; i < 60; i++) {
+      SHA1_STEP((b & c) | (d & (b | c)), 0x8f1bbcdc, i);
+    }
+#pragma GCC unroll 20
+    for (int i = 60; i < 80; i++) {
+      SHA1_STEP(b ^ c ^ d, 0xca62c1d6, i);
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+  }
+}
+
+#undef SHA1_STEP
+
+inline uint32_t Rotr(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+void SHA256CompressPortable(uint32_t* state, const uint8_t* blocks,
+                            size_t num_blocks) {
+  for (; num_blocks > 0; num_blocks--, blocks += kBlockSize) {
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+      w[i] = LoadBigEndian32(blocks + 4 * i);
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+        e = state[4], f = state[5], g = state[6], h = state[7];
+#pragma GCC unroll 64
+    for (int i = 0; i < 64; i++) {
+      if (i >= 16) {
+        uint32_t w15 = w[(i - 15) & 15];
+        uint32_t w2 = w[(i - 2) & 15];
+        w[i & 15] += (Rotr(w15, 7) ^ Rotr(w15, 18) ^ (w15 >> 3)) +
+            w[(i - 7) & 15] + (Rotr(w2, 17) ^ Rotr(w2, 19) ^ (w2 >> 10));
+      }
+      uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) +
+          (g ^ (e & (f ^ g))) + kSHA256K[i] + w[i & 15];
+      uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) +
+          ((a & b) | (c & (a | b)));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+// ---- OpenSSL ----
+// The low-level transforms run OpenSSL's assembly on our state words.
+
+#if defined(VOBLA_HAVE_OPENSSL_TRANSFORM)
+
+void MD5CompressOpenSSL(uint32_t* state, const uint8_t* blocks,
+                        size_t num_blocks) {
+  MD5_CTX ctx;
+  ctx.A = state[0];
+  ctx.B = state[1];
+  ctx.C = state[2];
+  ctx.D = state[3];
+  for (; num_blocks > 0; num_blocks--, blocks += kBlockSize) {
+    MD5_Transform(&ctx, blocks);
+  }
+  state[0] = ctx.A;
+  state[1] = ctx.B;
+  state[2] = ctx.C;
+  state[3] = ctx.D;
+}
+
+void SHA1CompressOpenSSL(uint32_t* state, const uint8_t* blocks,
+                         size_t num_blocks) {
+  SHA_CTX ctx;
+  ctx.h0 = state[0];
+  ctx.h1 = state[1];
+  ctx.h2 = state[2];
+  ctx.h3 = state[3];
+  ctx.h4 = state[4];
+  for (; num_blocks > 0; num_blocks--, blocks += kBlockSize) {
+    SHA1_Transform(&ctx, blocks);
+  }
+  state[0] = ctx.h0;
+  state[1] = ctx.h1;
+  state[2] = ctx.h2;
+  state[3] = ctx.h3;
+  state[4] = ctx.h4;
+}
+
+void SHA256CompressOpenSSL(uint32_t* state, const uint8_t* blocks,
+                           size_t num_blocks) {
+  SHA256_CTX ctx;
+  memcpy(ctx.h, state, sizeof(ctx.h));
+  for (; num_blocks > 0; num_blocks--, blocks += kBlockSize) {
+    SHA256_Transform(&ctx, blocks);
+  }
+  memcpy(state, ctx.h, sizeof(ctx.h));
+}
+
+#endif  // VOBLA_HAVE_OPENSSL_TRANSFORM
+
+// ---- SHA-NI ----
+
+#if defined(VOBLA_HAVE_X86_SIMD)
+
+/**
+ * Four SHA-1 rounds on message group 'g'. The group is loaded for g < 4
+ * and expanded from the previous four otherwise; w[g % 4] holds group
+ * g - 4 until it is replaced. Rounds take E from A four rounds earlier,
+ * kept in 'prev'.
+ */
+#define SHA1_ROUNDS4(g, func)                                               \
+  do {                                                                      \
+    __m128i wg;                                                             \
+    if ((g) < 4) {                                                          \
+      wg = _mm_shuffle_epi8(_mm_loadu_si128(                                \
+          reinterpret_cast<const __m128i*>(blocks + 16 * (g))), bswap);     \
+    } else {                                                                \
+      wg = _mm_sha1msg2_epu32(                                              \
+          _mm_xor_si128(_mm_sha1msg1_epu32(w[(g) % 4], w[((g) + 1) % 4]),   \
+                        w[((g) + 2) % 4]),                                  \
+          w[((g) + 3) % 4]);                                                \
+    }                                                                       \
+    w[(g) % 4] = wg;                                                        \
+    __m128i e_w = (g) == 0 ? _mm_add_epi32(e, wg)                           \
+                           : _mm_sha1nexte_epu32(prev, wg);                 \
+    prev = abcd;                                                            \
+    abcd = _mm_sha1rnds4_epu32(abcd, e_w, func);                            \
+  } while (0)
+
+__attribute__((target("sha,sse4.1")))
+void SHA1CompressShaNi(uint32_t* state, const uint8_t* blocks,
+                       size_t num_blocks) {
+  // Reverses the bytes of the block, so the first word is in lane 3.
+  const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL,
+                                       0x08090a0b0c0d0e0fULL);
+  // The rounds want A in lane 3 and E in lane 3 of its own register.
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1b);
+  __m128i e = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+  for (; num_blocks > 0; num_blocks--, blocks += kBlockSize) {
+    const __m128i abcd_save = abcd;
+    const __m128i e_save = e;
+    __m128i w[4];
+    __m128i prev;
+    SHA1_ROUNDS4(0, 0);
+    SHA1_ROUNDS4(1, 0);
+    SHA1_ROUNDS4(2, 0);
+    SHA1_ROUNDS4(3, 0);
+    SHA1_ROUNDS4(4, 0);
+    SHA1_ROUNDS4(5, 1);
+    SHA1_ROUNDS4(6, 1);
+    SHA1_ROUNDS4(7, 1);
+    SHA1_ROUNDS4(8, 1);
+    SHA1_ROUNDS4(9, 1);
+    SHA1_ROUNDS4(10, 2);
+    SHA1_ROUNDS4(11, 2);
+    SHA1_ROUNDS4(12, 2);
+    SHA1_ROUNDS4(13, 2);
+    SHA1_ROUNDS4(14, 2);
+    SHA1_ROUNDS4(15, 3);
+    SHA1_ROUNDS4(16, 3);
+    SHA1_ROUNDS4(17, 3);
+    SHA1_ROUNDS4(18, 3);
+    SHA1_ROUNDS4(19, 3);
+    e = _mm_sha1nexte_epu32(prev, e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_shuffle_epi32(abcd, 0x1b));
+  state[4] = static_cast<uint32_t>(_mm_extract_epi32(e, 3));
+}
+
+#undef SHA1_ROUNDS4
+
+__attribute__((target("sha,sse4.1")))
+void SHA256CompressShaNi(uint32_t* state, const uint8_t* blocks,
+                         size_t num_blocks) {
+  // Swaps the bytes of each word.
+  const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                       0x0405060700010203ULL);
+  // The rounds keep the state as ABEF and CDGH.
+  __m128i dcba = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xb1);
+  __m128i efgh = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1b);
+  __m128i abef = _mm_alignr_epi8(dcba, efgh, 8);
+  __m128i cdgh = _mm_blend_epi16(efgh, dcba, 0xf0);
+  for (; num_blocks > 0; num_blocks--, blocks += kBlockSize) {
+    const __m128i abef_save = abef;
+    const __m128i cdgh_save = cdgh;
+    // w[g % 4] holds message group g - 4 until group g replaces it.
+    __m128i w[4];
+#pragma GCC unroll 16
+    for (int g = 0; g < 16; g++) {
+      __m128i wg;
+      if (g < 4) {
+        wg = _mm_shuffle_epi8(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(blocks + 16 * g)), bswap);
+      } else {
+        const __m128i w4 = w[g % 4], w3 = w[(g + 1) % 4],
+            w2 = w[(g + 2) % 4], w1 = w[(g + 3) % 4];
+        wg = _mm_sha256msg2_epu32(
+            _mm_add_epi32(_mm_sha256msg1_epu32(w4, w3),
+                          _mm_alignr_epi8(w1, w2, 4)),
+            w1);
+      }
+      w[g % 4] = wg;
+      __m128i msg = _mm_add_epi32(wg, _mm_load_si128(
+          reinterpret_cast<const __m128i*>(kSHA256K + 4 * g)));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(msg, 0x0e));
+    }
+    abef = _mm_add_epi32(abef, abef_save);
+    cdgh = _mm_add_epi32(cdgh, cdgh_save);
+  }
+  __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+  __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_blend_epi16(feba, dchg, 0xf0));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4),
+                   _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#endif  // VOBLA_HAVE_X86_SIMD
+
+}  // anonymous namespace
+
+const std::vector<CompressBackend>& MD5Backends() {
+  static const std::vector<CompressBackend> backends = {
+#if defined(VOBLA_HAVE_OPENSSL_TRANSFORM)
+    {"openssl", MD5CompressOpenSSL},
+#endif
+    {"portable", MD5CompressPortable},
+  };
+  return backends;
+}
+
+const std::vector<CompressBackend>& SHA1Backends() {
+  static const std::vector<CompressBackend> backends = [] {
+    std::vector<CompressBackend> result;
+#if defined(VOBLA_HAVE_X86_SIMD)
+    if (SysInfo::HasCpuFeature(SysInfo::SHA) &&
+        SysInfo::HasCpuFeature(SysInfo::SSE4_2)) {
+      result.push_back({"sha-ni", SHA1CompressShaNi});
+    }
+#endif
+#if defined(VOBLA_HAVE_OPENSSL_TRANSFORM)
+    result.push_back({"openssl", SHA1CompressOpenSSL});
+#endif
+    result.push_back({"portable", SHA1CompressPortable});
+    return result;
+  }();
+  return backends;
+}
+
+const std::vector<CompressBackend>& SHA256Backends() {
+  static const std::vector<CompressBackend> backends = [] {
+    std::vector<CompressBackend> result;
+#if defined(VOBLA_HAVE_X86_SIMD)
+    if (SysInfo::HasCpuFeature(SysInfo::SHA) &&
+        SysInfo::HasCpuFeature(SysInfo::SSE4_2)) {
+      result.push_back({"sha-ni", SHA256CompressShaNi});
+    }
+#endif
+#if defined(VOBLA_HAVE_OPENSSL_TRANSFORM)
+    result.push_back({"openssl", SHA256CompressOpenSSL});
+#endif
+    result.push_back({"portable", SHA256CompressPortable});
+    return result;
+  }();
+  return backends;
+}
+
+}  // namespace hash_internal
+}  // namespace vobla
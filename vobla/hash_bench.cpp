@@ -0,0 +1,196 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The baseline calls the SHA1_* functions that OpenSSL 3 deprecates.
+#define OPENSSL_SUPPRESS_DEPRECATED 1
+
+#include <benchmark/benchmark.h>
+#include <openssl/sha.h>
+#include <string>
+#include <vector>
+#include "vobla/hash.h"
+#include "vobla/thread_pool.h"
+
+using std::string;
+using std::vector;
+
+namespace vobla {
+
+namespace {
+
+/// Makes 'lanes' distinct chunks of 'size' bytes each.
+vector<string> MakeChunks(size_t lanes, size_t size) {
+  vector<string> chunks;
+  for (size_t l = 0; l < lanes; l++) {
+    string chunk(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+      chunk[i] = static_cast<char>(i * 131 + l);
+    }
+    chunks.push_back(chunk);
+  }
+  return chunks;
+}
+
+/// Hashes state.range(0) chunks of state.range(1) bytes with ResetBatch().
+template <typename Digest>
+void BM_ResetBatch(benchmark::State& state) {
+  const vector<string> chunks = MakeChunks(state.range(0), state.range(1));
+  const vector<StringPiece> buffers(chunks.begin(), chunks.end());
+  vector<Digest> digests(buffers.size());
+  for (auto _ : state) {
+    Digest::ResetBatch(buffers.data(), buffers.size(), digests.data());
+    benchmark::DoNotOptimize(digests.data());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) *
+                          state.range(1));
+}
+
+/// The same workload as BM_ResetBatch, with one Reset() call per chunk.
+template <typename Digest>
+void BM_ResetEach(benchmark::State& state) {
+  const vector<string> chunks = MakeChunks(state.range(0), state.range(1));
+  vector<Digest> digests(chunks.size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < chunks.size(); i++) {
+      digests[i].Reset(chunks[i]);
+    }
+    benchmark::DoNotOptimize(digests.data());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0) *
+                          state.range(1));
+}
+
+/// Hashes one buffer of state.range(0) bytes with Reset().
+template <typename Digest>
+void BM_Reset(benchmark::State& state) {
+  const string buffer = MakeChunks(1, state.range(0))[0];
+  Digest digest;
+  for (auto _ : state) {
+    digest.Reset(buffer);
+    benchmark::DoNotOptimize(digest.digest());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+/// Hashes one buffer of state.range(0) bytes on the default thread pool.
+void BM_BLAKE3Parallel(benchmark::State& state) {
+  const string buffer = MakeChunks(1, state.range(0))[0];
+  BLAKE3Digest digest(ThreadPool::default_pool());
+  for (auto _ : state) {
+    digest.Reset(buffer);
+    benchmark::DoNotOptimize(digest.digest());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+/// Formats the digest of a fixed 4 KiB buffer as hexadecimal.
+template <typename Digest>
+void BM_Hexdigest(benchmark::State& state) {
+  Digest digest(MakeChunks(1, 4096)[0]);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(digest.hexdigest());
+  }
+}
+
+/// Formats into a caller-provided buffer, without allocating.
+template <typename Digest>
+void BM_HexdigestBuffer(benchmark::State& state) {
+  Digest digest(MakeChunks(1, 4096)[0]);
+  char buffer[Digest::LENGTH * 2];
+  for (auto _ : state) {
+    digest.hexdigest(buffer);
+    benchmark::DoNotOptimize(buffer);
+  }
+}
+
+/// Hashes state.range(0) bytes with one backend of 'Policy'.
+template <typename Policy>
+void BM_Backend(benchmark::State& state, const string& backend) {
+  const string buffer = MakeChunks(1, state.range(0))[0];
+  const string default_backend = Policy::backend();
+  Policy::SetBackend(backend);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Hasher<Policy>::Hash(buffer));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  Policy::SetBackend(default_backend);
+}
+
+/// The baseline: OpenSSL's SHA1_Update(), which SHA1Digest used to call.
+void BM_OpenSSLSHA1Update(benchmark::State& state) {
+  const string buffer = MakeChunks(1, state.range(0))[0];
+  unsigned char digest[SHA_DIGEST_LENGTH];
+  for (auto _ : state) {
+    SHA_CTX ctx;
+    SHA1_Init(&ctx);
+    SHA1_Update(&ctx, buffer.data(), buffer.size());
+    SHA1_Final(digest, &ctx);
+    benchmark::DoNotOptimize(digest);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Policy>
+void RegisterBackends(const string& algorithm) {
+  for (const auto& backend : Policy::backends()) {
+    benchmark::RegisterBenchmark(
+        ("BM_Backend/" + algorithm + "/" + backend).c_str(),
+        BM_Backend<Policy>, backend)->Range(64, 1 << 20);
+  }
+}
+
+const bool kBackendsRegistered = [] {
+  RegisterBackends<MD5Policy>("md5");
+  RegisterBackends<SHA1Policy>("sha1");
+  RegisterBackends<SHA256Policy>("sha256");
+  return true;
+}();
+
+/// Lanes x chunk size.
+void BatchArgs(benchmark::internal::Benchmark* b) {
+  for (int lanes : {1, 4, 8, 16}) {
+    for (int size : {4 << 10, 64 << 10}) {
+      b->Args({lanes, size});
+    }
+  }
+  b->ArgNames({"lanes", "size"});
+}
+
+}  // anonymous namespace
+
+BENCHMARK_TEMPLATE(BM_Reset, MD5Digest)->Range(64, 64 << 20);
+BENCHMARK_TEMPLATE(BM_Reset, SHA1Digest)->Range(64, 64 << 20);
+BENCHMARK_TEMPLATE(BM_Reset, SHA256Digest)->Range(64, 64 << 20);
+BENCHMARK_TEMPLATE(BM_Reset, BLAKE3Digest)->Range(64, 64 << 20);
+BENCHMARK(BM_BLAKE3Parallel)->Range(1 << 20, 64 << 20)->UseRealTime();
+
+BENCHMARK(BM_OpenSSLSHA1Update)->Range(64, 1 << 20);
+
+BENCHMARK_TEMPLATE(BM_Hexdigest, MD5Digest);
+BENCHMARK_TEMPLATE(BM_Hexdigest, SHA1Digest);
+BENCHMARK_TEMPLATE(BM_HexdigestBuffer, MD5Digest);
+BENCHMARK_TEMPLATE(BM_HexdigestBuffer, SHA1Digest);
+
+// Checksums versus MD5 on the same inputs.
+BENCHMARK_TEMPLATE(BM_Reset, CRC32CDigest)->Range(64, 1 << 20);
+BENCHMARK_TEMPLATE(BM_Reset, XXHash64Digest)->Range(64, 1 << 20);
+
+BENCHMARK_TEMPLATE(BM_ResetBatch, MD5Digest)->Apply(BatchArgs);
+BENCHMARK_TEMPLATE(BM_ResetEach, MD5Digest)->Apply(BatchArgs);
+BENCHMARK_TEMPLATE(BM_ResetBatch, SHA1Digest)->Apply(BatchArgs);
+BENCHMARK_TEMPLATE(BM_ResetEach, SHA1Digest)->Apply(BatchArgs);
+
+}  // namespace vobla
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file hash_internal.h
+ * \brief Hashing kernels shared by the digest classes. Not a public API.
+ */
+
+#ifndef VOBLA_HASH_INTERNAL_H_
+#define VOBLA_HASH_INTERNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "vobla/gutil/strings/stringpiece.h"
+
+// Kernels using x86 intrinsics are compiled with per-function target
+// attributes, so the library itself does not require -mavx2 and the CPU is
+// checked at runtime.
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define VOBLA_HAVE_X86_SIMD 1
+#endif
+
+namespace vobla {
+
+class ThreadPool;
+struct BLAKE3Context;
+struct XXHash64Context;
+
+namespace hash_internal {
+
+/// The initial MD5 state.
+extern const uint32_t kMD5IV[4];
+
+/// The initial SHA-1 state.
+extern const uint32_t kSHA1IV[5];
+
+/// The initial SHA-256 state.
+extern const uint32_t kSHA256IV[8];
+
+/// The additive constants of the 64 MD5 steps.
+extern const uint32_t kMD5K[64];
+
+/// Compresses 'num_blocks' consecutive 64-byte blocks into 'state'.
+typedef void (*CompressFunc)(uint32_t* state, const uint8_t* blocks,
+                             size_t num_blocks);
+
+/// One implementation of a compression function.
+struct CompressBackend {
+  const char* name;
+  CompressFunc compress;
+};
+
+/// Returns the MD5 implementations that run on this CPU, fastest first.
+const std::vector<CompressBackend>& MD5Backends();
+
+/// Returns the SHA-1 implementations that run on this CPU, fastest first.
+const std::vector<CompressBackend>& SHA1Backends();
+
+/// Returns the SHA-256 implementations that run on this CPU, fastest first.
+const std::vector<CompressBackend>& SHA256Backends();
+
+/// Number of independent buffers one multi-buffer kernel call hashes.
+const int kMultiBufferLanes = 8;
+
+/// Returns true if the interleaved multi-buffer kernels can run on this CPU.
+bool HasMultiBufferKernel();
+
+/**
+ * \brief Computes the MD5 of 'n' buffers with the 8-lane AVX2 kernel.
+ *
+ * The digest of buffers[i] is written to 'out + i * stride'.
+ * Requires HasMultiBufferKernel().
+ */
+void MD5MultiBuffer(const StringPiece* buffers, size_t n,
+                    unsigned char* out, size_t stride);
+
+/// Computes the SHA-1 of 'n' buffers. See MD5MultiBuffer().
+void SHA1MultiBuffer(const StringPiece* buffers, size_t n,
+                     unsigned char* out, size_t stride);
+
+/**
+ * \brief Extends 'crc', the CRC32C of some data, with 'size' more bytes.
+ *
+ * Crc32cExtend(0, data, size) is the CRC32C of 'data'.
+ */
+uint32_t Crc32cExtend(uint32_t crc, const void* data, size_t size);
+
+/// The table-driven Crc32cExtend(), used when SSE4.2 is not available.
+uint32_t Crc32cExtendPortable(uint32_t crc, const void* data, size_t size);
+
+void XXHash64Init(XXHash64Context* ctx, uint64_t seed);
+
+void XXHash64Update(XXHash64Context* ctx, const void* data, size_t size);
+
+uint64_t XXHash64Final(const XXHash64Context& ctx);
+
+void Blake3Init(BLAKE3Context* ctx);
+
+void Blake3Update(BLAKE3Context* ctx, const void* data, size_t size);
+
+/**
+ * \brief Same as Blake3Update(), but hashes whole subtrees of a large
+ * 'data' as tasks on 'pool' and waits for them.
+ */
+void Blake3UpdateParallel(BLAKE3Context* ctx, const void* data, size_t size,
+                          ThreadPool* pool);
+
+/// Writes the 32-byte digest. 'ctx' is left unchanged.
+void Blake3Final(const BLAKE3Context& ctx, unsigned char* out);
+
+}  // namespace hash_internal
+}  // namespace vobla
+
+#endif  // VOBLA_HASH_INTERNAL_H_
@@ -0,0 +1,462 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file hash_mb.cpp
+ * \brief Multi-buffer MD5 / SHA-1: each 32-bit AVX2 lane runs the
+ * compression function of an independent message.
+ */
+
+#include <glog/logging.h>
+#include <string.h>
+#include <algorithm>
+#include "vobla/hash_internal.h"
+#include "vobla/sysinfo.h"
+
+#if defined(VOBLA_HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+namespace vobla {
+namespace hash_internal {
+
+namespace {
+
+const size_t kBlockSize = 64;
+
+/// One message being fed through a kernel lane.
+struct Lane {
+  /// Index of the buffer in the batch.
+  size_t job;
+  /// The next block to compress.
+  const uint8_t* next;
+  /// Blocks left in the current segment (message body, then padded tail).
+  size_t blocks;
+  bool in_tail;
+  size_t tail_blocks;
+  /// The last partial block plus MD-style padding and length.
+  uint8_t tail[kBlockSize * 2];
+};
+
+/**
+ * \brief Feeds a batch of messages through an 8-lane compression kernel.
+ *
+ * Whenever a lane finishes its message the next pending message is loaded
+ * into it, so lanes stay busy until the batch drains. Traits supplies the
+ * kernel, the IV and the byte order of the length and digest words.
+ */
+template <typename Traits>
+void RunMultiBuffer(const StringPiece* buffers, size_t n,
+                    unsigned char* out, size_t stride) {
+  const int kWords = Traits::kWords;
+  uint32_t state[kWords * kMultiBufferLanes] __attribute__((aligned(32)));
+  Lane lanes[kMultiBufferLanes];
+  bool live[kMultiBufferLanes] = {false};
+  size_t next_job = 0;
+  int active = 0;
+
+  auto start = [&](int l) {
+    Lane* lane = &lanes[l];
+    const uint8_t* data =
+        reinterpret_cast<const uint8_t*>(buffers[next_job].data());
+    size_t length = buffers[next_job].size();
+    lane->job = next_job++;
+    lane->blocks = length / kBlockSize;
+    lane->next = data;
+    lane->in_tail = false;
+
+    size_t rest = length % kBlockSize;
+    lane->tail_blocks = rest + 9 <= kBlockSize ? 1 : 2;
+    size_t tail_size = lane->tail_blocks * kBlockSize;
+    if (rest) {
+      memcpy(lane->tail, data + lane->blocks * kBlockSize, rest);
+    }
+    lane->tail[rest] = 0x80;
+    memset(lane->tail + rest + 1, 0, tail_size - rest - 9);
+    uint64_t bits = static_cast<uint64_t>(length) * 8;
+    for (int i = 0; i < 8; i++) {
+      int shift = Traits::kBigEndian ? (56 - 8 * i) : 8 * i;
+      lane->tail[tail_size - 8 + i] = static_cast<uint8_t>(bits >> shift);
+    }
+    if (lane->blocks == 0) {
+      lane->next = lane->tail;
+      lane->blocks = lane->tail_blocks;
+      lane->in_tail = true;
+    }
+    for (int w = 0; w < kWords; w++) {
+      state[w * kMultiBufferLanes + l] = Traits::kIV[w];
+    }
+    live[l] = true;
+    active++;
+  };
+
+  for (int l = 0; l < kMultiBufferLanes && next_job < n; l++) {
+    start(l);
+  }
+  while (active > 0) {
+    size_t run = SIZE_MAX;
+    int first_live = -1;
+    for (int l = 0; l < kMultiBufferLanes; l++) {
+      if (live[l]) {
+        run = std::min(run, lanes[l].blocks);
+        if (first_live < 0) {
+          first_live = l;
+        }
+      }
+    }
+    // Idle lanes shadow a live lane, so every lane reads valid memory.
+    const uint8_t* blocks[kMultiBufferLanes];
+    for (int l = 0; l < kMultiBufferLanes; l++) {
+      blocks[l] = live[l] ? lanes[l].next : lanes[first_live].next;
+    }
+    Traits::Compress(state, blocks, run);
+
+    for (int l = 0; l < kMultiBufferLanes; l++) {
+      if (!live[l]) {
+        continue;
+      }
+      Lane* lane = &lanes[l];
+      lane->next += run * kBlockSize;
+      lane->blocks -= run;
+      if (lane->blocks > 0) {
+        continue;
+      }
+      if (!lane->in_tail) {
+        lane->next = lane->tail;
+        lane->blocks = lane->tail_blocks;
+        lane->in_tail = true;
+        continue;
+      }
+      unsigned char* digest = out + lane->job * stride;
+      for (int w = 0; w < kWords; w++) {
+        uint32_t word = state[w * kMultiBufferLanes + l];
+        for (int i = 0; i < 4; i++) {
+          int shift = Traits::kBigEndian ? (24 - 8 * i) : 8 * i;
+          digest[w * 4 + i] = static_cast<unsigned char>(word >> shift);
+        }
+      }
+      live[l] = false;
+      active--;
+      if (next_job < n) {
+        start(l);
+      }
+    }
+  }
+}
+
+#if defined(VOBLA_HAVE_X86_SIMD)
+
+#define VOBLA_AVX2 __attribute__((target("avx2")))
+
+VOBLA_AVX2 inline __m256i Rotl(__m256i x, int n) {
+  return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+/**
+ * Loads 32 bytes at 'offset' from each of the 8 lanes and transposes them,
+ * so that w[i] holds the i-th 32-bit message word of every lane.
+ */
+VOBLA_AVX2 inline void LoadTransposed(const uint8_t* const* blocks,
+                                      size_t offset, __m256i* w) {
+  __m256i r[8];
+  for (int l = 0; l < 8; l++) {
+    r[l] = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(blocks[l] + offset));
+  }
+  __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+  __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+  __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+  __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+  __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+  __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+  __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+  __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+  __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+  __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+  __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+  __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+  __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+  __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+  __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+  __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+  w[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+  w[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+  w[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+  w[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+  w[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+  w[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+  w[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+  w[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+// ---- MD5 ----
+
+#define MD5_F(b, c, d) \
+  _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)))
+#define MD5_G(b, c, d) \
+  _mm256_xor_si256(c, _mm256_and_si256(d, _mm256_xor_si256(b, c)))
+#define MD5_H(b, c, d) _mm256_xor_si256(_mm256_xor_si256(b, c), d)
+#define MD5_I(b, c, d) \
+  _mm256_xor_si256(c, _mm256_or_si256(b, _mm256_xor_si256(d, ones)))
+
+#define MD5_STEP(f, a, b, c, d, i, g, s)                                    \
+  a = _mm256_add_epi32(a, _mm256_add_epi32(f(b, c, d), _mm256_add_epi32(  \
+      m[g], _mm256_set1_epi32(static_cast<int>(kMD5K[i])))));             \
+  a = _mm256_add_epi32(b, Rotl(a, s))
+
+VOBLA_AVX2 void MD5CompressX8(uint32_t* state, const uint8_t* const* blocks,
+                              size_t nblocks) {
+  const __m256i ones = _mm256_set1_epi32(-1);
+  __m256i* s = reinterpret_cast<__m256i*>(state);
+  __m256i a = _mm256_load_si256(s), b = _mm256_load_si256(s + 1),
+      c = _mm256_load_si256(s + 2), d = _mm256_load_si256(s + 3);
+  for (size_t blk = 0; blk < nblocks; blk++) {
+    __m256i m[16];
+    LoadTransposed(blocks, blk * kBlockSize, m);
+    LoadTransposed(blocks, blk * kBlockSize + 32, m + 8);
+    __m256i aa = a, bb = b, cc = c, dd = d;
+
+    MD5_STEP(MD5_F, a, b, c, d, 0, 0, 7);
+    MD5_STEP(MD5_F, d, a, b, c, 1, 1, 12);
+    MD5_STEP(MD5_F, c, d, a, b, 2, 2, 17);
+    MD5_STEP(MD5_F, b, c, d, a, 3, 3, 22);
+    MD5_STEP(MD5_F, a, b, c, d, 4, 4, 7);
+    MD5_STEP(MD5_F, d, a, b, c, 5, 5, 12);
+    MD5_STEP(MD5_F, c, d, a, b, 6, 6, 17);
+    MD5_STEP(MD5_F, b, c, d, a, 7, 7, 22);
+    MD5_STEP(MD5_F, a, b, c, d, 8, 8, 7);
+    MD5_STEP(MD5_F, d, a, b, c, 9, 9, 12);
+    MD5_STEP(MD5_F, c, d, a, b, 10, 10, 17);
+    MD5_STEP(MD5_F, b, c, d, a, 11, 11, 22);
+    MD5_STEP(MD5_F, a, b, c, d, 12, 12, 7);
+    MD5_STEP(MD5_F, d, a, b, c, 13, 13, 12);
+    MD5_STEP(MD5_F, c, d, a, b, 14, 14, 17);
+    MD5_STEP(MD5_F, b, c, d, a, 15, 15, 22);
+
+    MD5_STEP(MD5_G, a, b, c, d, 16, 1, 5);
+    MD5_STEP(MD5_G, d, a, b, c, 17, 6, 9);
+    MD5_STEP(MD5_G, c, d, a, b, 18, 11, 14);
+    MD5_STEP(MD5_G, b, c, d, a, 19, 0, 20);
+    MD5_STEP(MD5_G, a, b, c, d, 20, 5, 5);
+    MD5_STEP(MD5_G, d, a, b, c, 21, 10, 9);
+    MD5_STEP(MD5_G, c, d, a, b, 22, 15, 14);
+    MD5_STEP(MD5_G, b, c, d, a, 23, 4, 20);
+    MD5_STEP(MD5_G, a, b, c, d, 24, 9, 5);
+    MD5_STEP(MD5_G, d, a, b, c, 25, 14, 9);
+    MD5_STEP(MD5_G, c, d, a, b, 26, 3, 14);
+    MD5_STEP(MD5_G, b, c, d, a, 27, 8, 20);
+    MD5_STEP(MD5_G, a, b, c, d, 28, 13, 5);
+    MD5_STEP(MD5_G, d, a, b, c, 29, 2, 9);
+    MD5_STEP(MD5_G, c, d, a, b, 30, 7, 14);
+    MD5_STEP(MD5_G, b, c, d, a, 31, 12, 20);
+
+    MD5_STEP(MD5_H, a, b, c, d, 32, 5, 4);
+    MD5_STEP(MD5_H, d, a, b, c, 33, 8, 11);
+    MD5_STEP(MD5_H, c, d, a, b, 34, 11, 16);
+    MD5_STEP(MD5_H, b, c, d, a, 35, 14, 23);
+    MD5_STEP(MD5_H, a, b, c, d, 36, 1, 4);
+    MD5_STEP(MD5_H, d, a, b, c, 37, 4, 11);
+    MD5_STEP(MD5_H, c, d, a, b, 38, 7, 16);
+    MD5_STEP(MD5_H, b, c, d, a, 39, 10, 23);
+    MD5_STEP(MD5_H, a, b, c, d, 40, 13, 4);
+    MD5_STEP(MD5_H, d, a, b, c, 41, 0, 11);
+    MD5_STEP(MD5_H, c, d, a, b, 42, 3, 16);
+    MD5_STEP(MD5_H, b, c, d, a, 43, 6, 23);
+    MD5_STEP(MD5_H, a, b, c, d, 44, 9, 4);
+    MD5_STEP(MD5_H, d, a, b, c, 45, 12, 11);
+    MD5_STEP(MD5_H, c, d, a, b, 46, 15, 16);
+    MD5_STEP(MD5_H, b, c, d, a, 47, 2, 23);
+
+    MD5_STEP(MD5_I, a, b, c, d, 48, 0, 6);
+    MD5_STEP(MD5_I, d, a, b, c, 49, 7, 10);
+    MD5_STEP(MD5_I, c, d, a, b, 50, 14, 15);
+    MD5_STEP(MD5_I, b, c, d, a, 51, 5, 21);
+    MD5_STEP(MD5_I, a, b, c, d, 52, 12, 6);
+    MD5_STEP(MD5_I, d, a, b, c, 53, 3, 10);
+    MD5_STEP(MD5_I, c, d, a, b, 54, 10, 15);
+    MD5_STEP(MD5_I, b, c, d, a, 55, 1, 21);
+    MD5_STEP(MD5_I, a, b, c, d, 56, 8, 6);
+    MD5_STEP(MD5_I, d, a, b, c, 57, 15, 10);
+    MD5_STEP(MD5_I, c, d, a, b, 58, 6, 15);
+    MD5_STEP(MD5_I, b, c, d, a, 59, 13, 21);
+    MD5_STEP(MD5_I, a, b, c, d, 60, 4, 6);
+    MD5_STEP(MD5_I, d, a, b, c, 61, 11, 10);
+    MD5_STEP(MD5_I, c, d, a, b, 62, 2, 15);
+    MD5_STEP(MD5_I, b, c, d, a, 63, 9, 21);
+
+    a = _mm256_add_epi32(a, aa);
+    b = _mm256_add_epi32(b, bb);
+    c = _mm256_add_epi32(c, cc);
+    d = _mm256_add_epi32(d, dd);
+  }
+  _mm256_store_si256(s, a);
+  _mm256_store_si256(s + 1, b);
+  _mm256_store_si256(s + 2, c);
+  _mm256_store_si256(s + 3, d);
+}
+
+#undef MD5_F
+#undef MD5_G
+#undef MD5_H
+#undef MD5_I
+#undef MD5_STEP
+
+// ---- SHA-1 ----
+
+#define SHA1_F0(b, c, d) \
+  _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)))
+#define SHA1_F1(b, c, d) _mm256_xor_si256(_mm256_xor_si256(b, c), d)
+#define SHA1_F2(b, c, d) _mm256_or_si256(_mm256_and_si256(b, c), \
+    _mm256_and_si256(d, _mm256_or_si256(b, c)))
+#define SHA1_F3 SHA1_F1
+
+VOBLA_AVX2 void SHA1CompressX8(uint32_t* state, const uint8_t* const* blocks,
+                               size_t nblocks) {
+  const __m256i bswap = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  const __m256i k[4] = {
+    _mm256_set1_epi32(0x5A827999),
+    _mm256_set1_epi32(0x6ED9EBA1),
+    _mm256_set1_epi32(static_cast<int>(0x8F1BBCDC)),
+    _mm256_set1_epi32(static_cast<int>(0xCA62C1D6)),
+  };
+  __m256i* s = reinterpret_cast<__m256i*>(state);
+  __m256i h0 = _mm256_load_si256(s), h1 = _mm256_load_si256(s + 1),
+      h2 = _mm256_load_si256(s + 2), h3 = _mm256_load_si256(s + 3),
+      h4 = _mm256_load_si256(s + 4);
+  for (size_t blk = 0; blk < nblocks; blk++) {
+    __m256i w[16];
+    LoadTransposed(blocks, blk * kBlockSize, w);
+    LoadTransposed(blocks, blk * kBlockSize + 32, w + 8);
+    for (int i = 0; i < 16; i++) {
+      w[i] = _mm256_shuffle_epi8(w[i], bswap);
+    }
+    __m256i a = h0, b = h1, c = h2, d = h3, e = h4;
+
+#define SHA1_ROUND(f, t)                                                    \
+    do {                                                                    \
+      __m256i wt;                                                           \
+      if ((t) < 16) {                                                       \
+        wt = w[(t)];                                                        \
+      } else {                                                              \
+        wt = Rotl(_mm256_xor_si256(                                         \
+            _mm256_xor_si256(w[((t) - 3) & 15], w[((t) - 8) & 15]),         \
+            _mm256_xor_si256(w[((t) - 14) & 15], w[(t) & 15])), 1);         \
+        w[(t) & 15] = wt;                                                   \
+      }                                                                     \
+      __m256i tmp = _mm256_add_epi32(_mm256_add_epi32(Rotl(a, 5), f(b, c, d)), \
+          _mm256_add_epi32(_mm256_add_epi32(e, k[(t) / 20]), wt));          \
+      e = d;                                                                \
+      d = c;                                                                \
+      c = Rotl(b, 30);                                                      \
+      b = a;                                                                \
+      a = tmp;                                                              \
+    } while (0)
+
+#pragma GCC unroll 20
+    for (int t = 0; t < 20; t++) {
+      SHA1_ROUND(SHA1_F0, t);
+    }
+#pragma GCC unroll 20
+    for (int t = 20; t < 40; t++) {
+      SHA1_ROUND(SHA1_F1, t);
+    }
+#pragma GCC unroll 20
+    for (int t = 40; t < 60; t++) {
+      SHA1_ROUND(SHA1_F2, t);
+    }
+#pragma GCC unroll 20
+    for (int t = 60; t < 80; t++) {
+      SHA1_ROUND(SHA1_F3, t);
+    }
+#undef SHA1_ROUND
+
+    h0 = _mm256_add_epi32(h0, a);
+    h1 = _mm256_add_epi32(h1, b);
+    h2 = _mm256_add_epi32(h2, c);
+    h3 = _mm256_add_epi32(h3, d);
+    h4 = _mm256_add_epi32(h4, e);
+  }
+  _mm256_store_si256(s, h0);
+  _mm256_store_si256(s + 1, h1);
+  _mm256_store_si256(s + 2, h2);
+  _mm256_store_si256(s + 3, h3);
+  _mm256_store_si256(s + 4, h4);
+}
+
+#undef SHA1_F0
+#undef SHA1_F1
+#undef SHA1_F2
+#undef SHA1_F3
+#undef VOBLA_AVX2
+
+#endif  // VOBLA_HAVE_X86_SIMD
+
+struct MD5Traits {
+  enum { kWords = 4 };
+  static const bool kBigEndian = false;
+  static const uint32_t* const kIV;
+
+  static void Compress(uint32_t* state, const uint8_t* const* blocks,
+                       size_t nblocks) {
+#if defined(VOBLA_HAVE_X86_SIMD)
+    MD5CompressX8(state, blocks, nblocks);
+#endif
+  }
+};
+
+const uint32_t* const MD5Traits::kIV = kMD5IV;
+
+struct SHA1Traits {
+  enum { kWords = 5 };
+  static const bool kBigEndian = true;
+  static const uint32_t* const kIV;
+
+  static void Compress(uint32_t* state, const uint8_t* const* blocks,
+                       size_t nblocks) {
+#if defined(VOBLA_HAVE_X86_SIMD)
+    SHA1CompressX8(state, blocks, nblocks);
+#endif
+  }
+};
+
+const uint32_t* const SHA1Traits::kIV = kSHA1IV;
+
+}  // anonymous namespace
+
+bool HasMultiBufferKernel() {
+#if defined(VOBLA_HAVE_X86_SIMD)
+  return SysInfo::HasCpuFeature(SysInfo::AVX2);
+#else
+  return false;
+#endif
+}
+
+void MD5MultiBuffer(const StringPiece* buffers, size_t n,
+                    unsigned char* out, size_t stride) {
+  DCHECK(HasMultiBufferKernel());
+  RunMultiBuffer<MD5Traits>(buffers, n, out, stride);
+}
+
+void SHA1MultiBuffer(const StringPiece* buffers, size_t n,
+                     unsigned char* out, size_t stride) {
+  DCHECK(HasMultiBufferKernel());
+  RunMultiBuffer<SHA1Traits>(buffers, n, out, stride);
+}
+
+}  // namespace hash_internal
+}  // namespace vobla
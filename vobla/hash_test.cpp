@@ -15,10 +15,18 @@
  */
 
 #include <gtest/gtest.h>
+#include <string.h>
+#include <algorithm>
 #include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
 #include "vobla/hash.h"
+#include "vobla/hash_internal.h"
+#include "vobla/thread_pool.h"
 
 using std::string;
+using std::vector;
 
 namespace vobla {
 
@@ -44,4 +52,383 @@ TEST(HashDigestTest, SHA1Create) {
   EXPECT_EQ(sha1_2.hexdigest(), "69bca99b923859f2dc486b55b87f49689b7358c7");
 }
 
+TEST(HashDigestTest, ParseHexdigest) {
+  const SHA1Digest expected("abcdefg\n");
+  SHA1Digest parsed;
+  EXPECT_TRUE(parsed.ParseHexdigest(expected.hexdigest()).ok());
+  EXPECT_EQ(expected, parsed);
+  EXPECT_TRUE(parsed.ParseHexdigest(
+      "69BCA99B923859F2DC486B55B87F49689B7358C7").ok());
+  EXPECT_EQ(expected, parsed);
+
+  // Errors leave the digest unchanged.
+  EXPECT_FALSE(parsed.ParseHexdigest("69bca99b").ok());
+  EXPECT_FALSE(parsed.ParseHexdigest(
+      "69bca99b923859f2dc486b55b87f49689b7358cx").ok());
+  EXPECT_EQ(expected, parsed);
+
+  char hex[MD5Digest::LENGTH * 2];
+  MD5Digest("abcdefg\n").hexdigest(hex);
+  EXPECT_EQ("020861c8c3fe177da19a7e9539a5dbac", string(hex, sizeof(hex)));
+
+  Digest<16> md5;
+  EXPECT_TRUE(md5.ParseHexdigest(string(hex, sizeof(hex))).ok());
+  EXPECT_EQ(MD5Digest("abcdefg\n").value(), md5);
+}
+
+TEST(HashDigestTest, UpdateFromRawBuffer) {
+  const string buf("abcdefg\n");
+  SHA1Digest sha1_0;
+  sha1_0.Init();
+  sha1_0.Update(buf.data(), 3);
+  sha1_0.Update(StringPiece(buf.data() + 3, buf.size() - 3));
+  sha1_0.Final();
+  EXPECT_EQ(sha1_0.hexdigest(), "69bca99b923859f2dc486b55b87f49689b7358c7");
+
+  MD5Digest md5_0;
+  md5_0.Reset(buf.data(), buf.size());
+  EXPECT_EQ(md5_0.hexdigest(), "020861c8c3fe177da19a7e9539a5dbac");
+}
+
+TEST(HashDigestTest, UpdateWithEmptyBuffer) {
+  MD5Digest md5_0;
+  md5_0.Init();
+  md5_0.Update(nullptr, 0);
+  md5_0.Update("");
+  md5_0.Final();
+  EXPECT_EQ(md5_0.hexdigest(), "d41d8cd98f00b204e9800998ecf8427e");
+
+  SHA1Digest sha1_0;
+  sha1_0.Reset(StringPiece());
+  EXPECT_EQ(sha1_0.hexdigest(), "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+}
+
+TEST(HashDigestTest, CRC32CCreate) {
+  // Test vectors from RFC 3720, B.4.
+  EXPECT_EQ(0x8a9136aau, CRC32CDigest(string(32, '\0')).checksum());
+  EXPECT_EQ(0x62a8ab43u, CRC32CDigest(string(32, '\xff')).checksum());
+  string ascending;
+  for (int i = 0; i < 32; i++) {
+    ascending.push_back(static_cast<char>(i));
+  }
+  EXPECT_EQ(0x46dd794eu, CRC32CDigest(ascending).checksum());
+
+  CRC32CDigest crc("123456789");
+  EXPECT_EQ(0xe3069283u, crc.checksum());
+  EXPECT_EQ("e3069283", crc.hexdigest());
+  EXPECT_EQ("00000000", CRC32CDigest("").hexdigest());
+}
+
+TEST(HashDigestTest, CRC32CHardwareMatchesPortable) {
+  // Long enough for the interleaved streams, at every alignment.
+  string buf(20000, '\0');
+  for (size_t i = 0; i < buf.size(); i++) {
+    buf[i] = static_cast<char>(i * 13 + i / 256);
+  }
+  for (size_t offset = 0; offset < 8; offset++) {
+    for (size_t size : {0, 1, 7, 100, 3071, 3072, 3073, 9000, 19990}) {
+      EXPECT_EQ(
+          hash_internal::Crc32cExtendPortable(0, buf.data() + offset, size),
+          hash_internal::Crc32cExtend(0, buf.data() + offset, size))
+          << "offset: " << offset << " size: " << size;
+    }
+  }
+
+  CRC32CDigest streaming;
+  streaming.Init();
+  streaming.Update(buf.data(), 5000);
+  streaming.Update(buf.data() + 5000, buf.size() - 5000);
+  streaming.Final();
+  EXPECT_EQ(CRC32CDigest(buf), streaming);
+}
+
+TEST(HashDigestTest, XXHash64Create) {
+  EXPECT_EQ(0xef46db3751d8e999ull, XXHash64Digest("").checksum());
+  EXPECT_EQ("d24ec4f1a98c6e5b", XXHash64Digest("a").hexdigest());
+  EXPECT_EQ("44bc2cf5ad770999", XXHash64Digest("abc").hexdigest());
+
+  // Streaming across the 32-byte stripe boundary matches one-shot hashing.
+  string buf(1000, 'z');
+  for (size_t i = 0; i < buf.size(); i++) {
+    buf[i] = static_cast<char>(i * 7);
+  }
+  for (size_t split : {1, 31, 32, 33, 500}) {
+    XXHash64Digest streaming;
+    streaming.Init();
+    streaming.Update(buf.data(), split);
+    streaming.Update(buf.data() + split, buf.size() - split);
+    streaming.Final();
+    EXPECT_EQ(XXHash64Digest(buf), streaming) << "split: " << split;
+  }
+}
+
+TEST(HashDigestTest, HasherMatchesDigest) {
+  const string buf("abcdefg\n");
+  EXPECT_EQ(SHA1Digest(buf).value(), SHA1Hasher::Hash(buf));
+
+  MD5Hasher md5;
+  md5.Init();
+  md5.Update(buf.data(), 3);
+  md5.Update(StringPiece(buf.data() + 3, buf.size() - 3));
+  EXPECT_EQ(MD5Digest(buf).value(), md5.Final());
+
+  EXPECT_EQ(CRC32CDigest("123456789").value(),
+            CRC32CHasher::Hash("123456789"));
+  EXPECT_EQ(XXHash64Digest(buf).value(), XXHash64Hasher::Hash(buf));
+}
+
+TEST(HashDigestTest, CompactDigestValue) {
+  static_assert(sizeof(SHA1Hasher::value_type) == 20,
+                "Stored digests carry no hashing context");
+  static_assert(sizeof(CRC32CHasher::value_type) == 4,
+                "Stored digests carry no hashing context");
+  static_assert(std::is_trivially_copyable<Digest<20>>::value,
+                "Digest must be trivially copyable");
+
+  const SHA1Digest sha1("abcdefg\n");
+  const Digest<20> value = sha1.value();
+  EXPECT_EQ(sha1.hexdigest(), value.hexdigest());
+  EXPECT_EQ(0, memcmp(sha1.digest(), value.data(), value.size()));
+  EXPECT_EQ(std::hash<Digest<20>>()(value), value.prefix());
+
+  // Orders like the digest classes, including on bytes past the prefix.
+  vector<string> inputs = { "a", "b", "c", "abcdefg\n", "" };
+  for (const string& lhs : inputs) {
+    for (const string& rhs : inputs) {
+      EXPECT_EQ(SHA1Digest(lhs) < SHA1Digest(rhs),
+                SHA1Hasher::Hash(lhs) < SHA1Hasher::Hash(rhs));
+      EXPECT_EQ(CRC32CDigest(lhs) < CRC32CDigest(rhs),
+                CRC32CHasher::Hash(lhs) < CRC32CHasher::Hash(rhs));
+    }
+  }
+  uint8_t bytes[20] = {0};
+  Digest<20> low(bytes);
+  bytes[19] = 1;
+  Digest<20> high(bytes);
+  EXPECT_TRUE(low < high);
+  EXPECT_FALSE(high < low);
+  EXPECT_NE(low, high);
+
+  std::unordered_set<Digest<20>> index;
+  index.insert(value);
+  EXPECT_EQ(1u, index.count(SHA1Hasher::Hash("abcdefg\n")));
+}
+
+template <typename HashDigest>
+void ExpectBatchMatchesReset(const vector<string>& inputs) {
+  vector<StringPiece> buffers(inputs.begin(), inputs.end());
+  vector<HashDigest> digests(buffers.size());
+  HashDigest::ResetBatch(buffers.data(), buffers.size(), digests.data());
+  vector<Digest<HashDigest::LENGTH>> values(buffers.size());
+  HashDigest::ResetBatch(buffers.data(), buffers.size(), values.data());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    EXPECT_EQ(HashDigest(inputs[i]), digests[i]) << "input size: "
+                                                  << inputs[i].size();
+    EXPECT_EQ(HashDigest(inputs[i]).value(), values[i]) << "input size: "
+                                                        << inputs[i].size();
+  }
+}
+
+TEST(HashDigestTest, ResetBatch) {
+  // Covers every tail length and batches larger than the lane count, so
+  // lanes get refilled with messages of different lengths.
+  vector<string> inputs;
+  for (size_t size = 0; size < 300; size++) {
+    string buf(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+      buf[i] = static_cast<char>(i * 31 + size);
+    }
+    inputs.push_back(buf);
+  }
+  inputs.push_back(string(64 * 1024 + 7, 'x'));
+  ExpectBatchMatchesReset<MD5Digest>(inputs);
+  ExpectBatchMatchesReset<SHA1Digest>(inputs);
+
+  vector<string> single = { "abcdefg\n" };
+  ExpectBatchMatchesReset<MD5Digest>(single);
+  ExpectBatchMatchesReset<SHA1Digest>(single);
+}
+
+namespace {
+
+/// Checks every backend of 'Policy' against known digests and each other.
+template <typename Policy>
+void ExpectBackendsAgree(const vector<std::pair<string, string>>& vectors) {
+  typedef Hasher<Policy> TestHasher;
+  const string default_backend = Policy::backend();
+  const vector<string> backends = Policy::backends();
+  EXPECT_EQ(backends.front(), default_backend);
+
+  vector<string> inputs;
+  for (size_t size = 0; size < 300; size += 7) {
+    string buf(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+      buf[i] = static_cast<char>(i * 17 + size);
+    }
+    inputs.push_back(buf);
+  }
+  vector<typename TestHasher::value_type> expected;
+  for (const auto& input : inputs) {
+    expected.push_back(TestHasher::Hash(input));
+  }
+
+  for (const auto& name : backends) {
+    ASSERT_TRUE(Policy::SetBackend(name).ok());
+    EXPECT_EQ(name, Policy::backend());
+    for (const auto& v : vectors) {
+      EXPECT_EQ(v.second, TestHasher::Hash(v.first).hexdigest()) << name;
+    }
+    for (size_t i = 0; i < inputs.size(); i++) {
+      // Uneven updates cover partial, whole and straddled blocks.
+      TestHasher hasher;
+      hasher.Init();
+      StringPiece rest(inputs[i]);
+      for (size_t n = 1; !rest.empty(); n = n * 3 + 1) {
+        hasher.Update(rest.substr(0, n));
+        rest.remove_prefix(std::min<size_t>(n, rest.size()));
+      }
+      EXPECT_EQ(expected[i], hasher.Final()) << name << " size "
+                                             << inputs[i].size();
+    }
+  }
+  EXPECT_EQ(-EINVAL, Policy::SetBackend("no-such-backend").error());
+  EXPECT_TRUE(Policy::SetBackend(default_backend).ok());
+}
+
+}  // anonymous namespace
+
+TEST(HashDigestTest, Backends) {
+  const string million_a(1000000, 'a');
+  ExpectBackendsAgree<MD5Policy>({
+    {"", "d41d8cd98f00b204e9800998ecf8427e"},
+    {"abc", "900150983cd24fb0d6963f7d28e17f72"},
+    {"1234567890123456789012345678901234567890"
+     "1234567890123456789012345678901234567890",
+     "57edf4a22be3c955ac49da2e2107b67a"},
+    {million_a, "7707d6ae4e027c70eea2a935c2296f21"},
+  });
+  ExpectBackendsAgree<SHA1Policy>({
+    {"", "da39a3ee5e6b4b0d3255bfef95601890afd80709"},
+    {"abc", "a9993e364706816aba3e25717850c26c9cd0d89d"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     "84983e441c3bd26ebaae4aa1f95129e5e54670f1"},
+    {million_a, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"},
+  });
+  ExpectBackendsAgree<SHA256Policy>({
+    {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+    {"abc",
+     "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+    {million_a,
+     "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+  });
+}
+
+/// The input of the official BLAKE3 test vectors.
+string Blake3TestInput(size_t size) {
+  string input(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    input[i] = static_cast<char>(i % 251);
+  }
+  return input;
+}
+
+TEST(HashDigestTest, BLAKE3Create) {
+  EXPECT_EQ("af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262",
+            BLAKE3Digest("").hexdigest());
+  EXPECT_EQ("6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85",
+            BLAKE3Digest("abc").hexdigest());
+  EXPECT_EQ("42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7",
+            BLAKE3Digest(Blake3TestInput(1024)).hexdigest());
+  EXPECT_EQ("d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444",
+            BLAKE3Digest(Blake3TestInput(1025)).hexdigest());
+  EXPECT_EQ("e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a",
+            BLAKE3Digest(Blake3TestInput(2048)).hexdigest());
+}
+
+TEST(HashDigestTest, BLAKE3ParallelMatchesSerial) {
+  ThreadPool pool(4);
+  // Sizes around multiples of the 512 KB subtrees hashed by pool tasks.
+  const size_t kSubtree = 512 * 1024;
+  for (size_t size : {3 * kSubtree - 1, 3 * kSubtree, 3 * kSubtree + 1,
+                      7 * kSubtree + 1000}) {
+    const string input = Blake3TestInput(size);
+    const BLAKE3Digest expected(input);
+    // Start the parallel update at an unaligned offset.
+    for (size_t head : {size_t(0), size_t(1024), size_t(5000)}) {
+      BLAKE3Digest digest(&pool);
+      digest.Init();
+      digest.Update(input.data(), head);
+      digest.Update(input.data() + head, size - head);
+      digest.Final();
+      EXPECT_EQ(expected, digest) << size << " " << head;
+    }
+  }
+}
+
+template <typename Digest>
+void ExpectSnapshotResumes() {
+  const string input = Blake3TestInput(5000);
+  const Digest expected(input);
+  for (size_t split : {0, 1, 63, 64, 1000, 1024, 4096}) {
+    Digest first;
+    first.Init();
+    first.Update(input.data(), split);
+    const string snapshot = first.Snapshot();
+
+    Digest resumed;
+    ASSERT_TRUE(resumed.Restore(snapshot).ok());
+    resumed.Update(input.data() + split, input.size() - split);
+    resumed.Final();
+    EXPECT_EQ(expected, resumed) << split;
+
+    // Truncated or extended snapshots are rejected.
+    EXPECT_EQ(-EINVAL,
+              resumed.Restore(snapshot.substr(0, snapshot.size() - 1))
+                  .error());
+    EXPECT_EQ(-EINVAL, resumed.Restore(snapshot + "x").error());
+  }
+}
+
+TEST(HashDigestTest, SnapshotAndRestore) {
+  ExpectSnapshotResumes<MD5Digest>();
+  ExpectSnapshotResumes<SHA1Digest>();
+  ExpectSnapshotResumes<SHA256Digest>();
+  ExpectSnapshotResumes<BLAKE3Digest>();
+  ExpectSnapshotResumes<CRC32CDigest>();
+  ExpectSnapshotResumes<XXHash64Digest>();
+
+  // A snapshot only restores into the same algorithm.
+  MD5Digest md5;
+  md5.Init();
+  SHA1Digest sha1;
+  EXPECT_EQ(-EINVAL, sha1.Restore(md5.Snapshot()).error());
+  EXPECT_EQ(-EINVAL, sha1.Restore("").error());
+
+  // A BLAKE3 chunk counter beyond 2^54 chunks would overflow the CV stack.
+  BLAKE3Digest blake3;
+  blake3.Init();
+  string snapshot = blake3.Snapshot();
+  // The version and tag bytes, then the chunk CV.
+  const size_t kCounterOffset = 2 + 32;
+  ASSERT_EQ(kCounterOffset + 8 + 3, snapshot.size());
+  const uint64_t counter = (uint64_t(1) << 55) - 1;
+  for (int i = 0; i < 8; i++) {
+    snapshot[kCounterOffset + i] = static_cast<char>(counter >> (8 * i));
+  }
+  snapshot.back() = 55;
+  snapshot.append(55 * 32, '\0');
+  EXPECT_EQ(-EINVAL, blake3.Restore(snapshot).error());
+
+  SHA1Hasher hasher;
+  hasher.Init();
+  hasher.Update("ab");
+  SHA1Hasher resumed;
+  ASSERT_TRUE(resumed.Restore(hasher.Snapshot()).ok());
+  resumed.Update("c");
+  EXPECT_EQ("a9993e364706816aba3e25717850c26c9cd0d89d",
+            resumed.Final().hexdigest());
+}
+
 }  // namespace vobla
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include "vobla/hash_internal.h"
+#include "vobla/hex.h"
+#include "vobla/sysinfo.h"
+
+#if defined(VOBLA_HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+
+namespace vobla {
+
+namespace {
+
+const char kHexDigits[] = "0123456789abcdef";
+
+/// Maps a character to its hexadecimal value, or to 0xff if invalid.
+struct HexValues {
+  uint8_t value[256];
+
+  HexValues() {
+    for (int c = 0; c < 256; c++) {
+      value[c] = 0xff;
+    }
+    for (int i = 0; i < 10; i++) {
+      value['0' + i] = static_cast<uint8_t>(i);
+    }
+    for (int i = 0; i < 6; i++) {
+      value['a' + i] = static_cast<uint8_t>(10 + i);
+      value['A' + i] = static_cast<uint8_t>(10 + i);
+    }
+  }
+};
+
+const HexValues kHexValues;
+
+void EncodeScalar(const uint8_t* in, size_t size, char* out) {
+  for (size_t i = 0; i < size; i++) {
+    out[2 * i] = kHexDigits[in[i] >> 4];
+    out[2 * i + 1] = kHexDigits[in[i] & 0xf];
+  }
+}
+
+bool DecodeScalar(const char* hex, size_t size, uint8_t* out) {
+  uint8_t invalid = 0;
+  for (size_t i = 0; i < size; i++) {
+    uint8_t hi = kHexValues.value[static_cast<uint8_t>(hex[2 * i])];
+    uint8_t lo = kHexValues.value[static_cast<uint8_t>(hex[2 * i + 1])];
+    invalid |= (hi | lo) & 0xf0;
+    out[i] = static_cast<uint8_t>((hi << 4) | (lo & 0xf));
+  }
+  return invalid == 0;
+}
+
+#if defined(VOBLA_HAVE_X86_SIMD)
+
+#define VOBLA_SSSE3 __attribute__((target("ssse3")))
+#define VOBLA_AVX2 __attribute__((target("avx2")))
+
+/// Encodes 16 bytes into 32 characters.
+VOBLA_SSSE3 inline void Encode16(const uint8_t* in, char* out) {
+  const __m128i digits =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(kHexDigits));
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+  __m128i hi = _mm_shuffle_epi8(digits,
+                                _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+  __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(x, mask));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                   _mm_unpacklo_epi8(hi, lo));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16),
+                   _mm_unpackhi_epi8(hi, lo));
+}
+
+/**
+ * Maps 16 characters to their nibble values, and sets 'invalid' to non-zero
+ * bits for non-hexadecimal characters.
+ */
+VOBLA_SSSE3 inline __m128i Nibbles16(__m128i c, __m128i* invalid) {
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i five = _mm_set1_epi8(5);
+  __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+  __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, nine), digit);
+  __m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+                               _mm_set1_epi8('a'));
+  __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, five), alpha);
+  *invalid = _mm_or_si128(*invalid, _mm_andnot_si128(
+      _mm_or_si128(is_digit, is_alpha), _mm_set1_epi8(-1)));
+  return _mm_or_si128(
+      _mm_and_si128(is_digit, digit),
+      _mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+}
+
+/// Decodes 32 characters into 16 bytes.
+VOBLA_SSSE3 inline bool Decode16(const char* hex, uint8_t* out) {
+  // Each byte is hi * 16 + lo, summed over adjacent character pairs.
+  const __m128i weights = _mm_set1_epi16(0x0110);
+  __m128i invalid = _mm_setzero_si128();
+  __m128i a = Nibbles16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(hex)), &invalid);
+  __m128i b = Nibbles16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + 16)), &invalid);
+  __m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(a, weights),
+                                   _mm_maddubs_epi16(b, weights));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), bytes);
+  return _mm_movemask_epi8(invalid) == 0;
+}
+
+VOBLA_SSSE3 void EncodeSSSE3(const uint8_t* in, size_t size, char* out) {
+  for (; size >= 16; size -= 16, in += 16, out += 32) {
+    Encode16(in, out);
+  }
+  EncodeScalar(in, size, out);
+}
+
+VOBLA_SSSE3 bool DecodeSSSE3(const char* hex, size_t size, uint8_t* out) {
+  bool valid = true;
+  for (; size >= 16; size -= 16, hex += 32, out += 16) {
+    valid &= Decode16(hex, out);
+  }
+  return DecodeScalar(hex, size, out) && valid;
+}
+
+VOBLA_AVX2 void EncodeAVX2(const uint8_t* in, size_t size, char* out) {
+  const __m256i digits = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(kHexDigits)));
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  for (; size >= 32; size -= 32, in += 32, out += 64) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+    __m256i hi = _mm256_shuffle_epi8(
+        digits, _mm256_and_si256(_mm256_srli_epi16(x, 4), mask));
+    __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(x, mask));
+    // Unpacking works within 128-bit halves: 'first' holds the characters
+    // of bytes 0-7 and 16-23, 'second' those of bytes 8-15 and 24-31.
+    __m256i first = _mm256_unpacklo_epi8(hi, lo);
+    __m256i second = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                        _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 32),
+                        _mm256_permute2x128_si256(first, second, 0x31));
+  }
+  // The compiler may turn the call below into a jump without clearing the
+  // upper halves, and the non-VEX SSE code would then pay an AVX-SSE
+  // transition penalty on every instruction.
+  _mm256_zeroupper();
+  EncodeSSSE3(in, size, out);
+}
+
+#undef VOBLA_SSSE3
+#undef VOBLA_AVX2
+
+#endif  // VOBLA_HAVE_X86_SIMD
+
+typedef void (*EncodeFunc)(const uint8_t*, size_t, char*);
+typedef bool (*DecodeFunc)(const char*, size_t, uint8_t*);
+
+EncodeFunc SelectEncode() {
+#if defined(VOBLA_HAVE_X86_SIMD)
+  if (SysInfo::HasCpuFeature(SysInfo::AVX2)) {
+    return EncodeAVX2;
+  }
+  if (SysInfo::HasCpuFeature(SysInfo::SSSE3)) {
+    return EncodeSSSE3;
+  }
+#endif
+  return EncodeScalar;
+}
+
+DecodeFunc SelectDecode() {
+#if defined(VOBLA_HAVE_X86_SIMD)
+  if (SysInfo::HasCpuFeature(SysInfo::SSSE3)) {
+    return DecodeSSSE3;
+  }
+#endif
+  return DecodeScalar;
+}
+
+}  // anonymous namespace
+
+void HexEncode(const void* data, size_t size, char* out) {
+  static const EncodeFunc encode = SelectEncode();
+  encode(static_cast<const uint8_t*>(data), size, out);
+}
+
+bool HexDecode(const char* hex, size_t size, void* out) {
+  static const DecodeFunc decode = SelectDecode();
+  return decode(hex, size, static_cast<uint8_t*>(out));
+}
+
+}  // namespace vobla
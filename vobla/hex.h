@@ -0,0 +1,57 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file hex.h
+ * \brief Hexadecimal encoding and decoding of binary data.
+ *
+ * Both directions write into caller-provided buffers and never allocate.
+ * They use AVX2 or SSSE3 when the CPU supports them.
+ */
+
+#ifndef VOBLA_HEX_H_
+#define VOBLA_HEX_H_
+
+#include <stddef.h>
+
+namespace vobla {
+
+/**
+ * \brief Encodes 'size' bytes as lowercase hexadecimal.
+ *
+ * \param[in] data the bytes to encode.
+ * \param[in] size the number of bytes in 'data'.
+ * \param[out] out receives exactly 2 * size characters, without a
+ * terminating NUL.
+ */
+void HexEncode(const void* data, size_t size, char* out);
+
+/**
+ * \brief Decodes 2 * size hexadecimal characters into 'size' bytes.
+ *
+ * Accepts both upper and lower case digits.
+ *
+ * \param[in] hex 2 * size hexadecimal characters.
+ * \param[in] size the number of bytes to produce.
+ * \param[out] out receives 'size' bytes. Its content is unspecified when
+ * the input is invalid.
+ * \return false if 'hex' contains a non-hexadecimal character.
+ */
+bool HexDecode(const char* hex, size_t size, void* out);
+
+}  // namespace vobla
+
+#endif  // VOBLA_HEX_H_
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include "vobla/hex.h"
+
+using std::string;
+
+namespace vobla {
+
+namespace {
+
+string Bytes(size_t size) {
+  string bytes(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    bytes[i] = static_cast<char>(i * 37 + 11);
+  }
+  return bytes;
+}
+
+/// The obvious implementation, to check the vectorized paths against.
+string ReferenceHex(const string& bytes) {
+  string hex;
+  char buf[3];
+  for (unsigned char c : bytes) {
+    snprintf(buf, sizeof(buf), "%02x", c);
+    hex += buf;
+  }
+  return hex;
+}
+
+}  // anonymous namespace
+
+TEST(HexTest, EncodeAndDecode) {
+  // Covers the AVX2 (32 bytes), SSSE3 (16 bytes) and scalar tails.
+  for (size_t size = 0; size <= 100; size++) {
+    const string bytes = Bytes(size);
+    string hex(2 * size, '?');
+    HexEncode(bytes.data(), size, &hex[0]);
+    EXPECT_EQ(ReferenceHex(bytes), hex);
+
+    string decoded(size, '\0');
+    EXPECT_TRUE(HexDecode(hex.data(), size, &decoded[0]));
+    EXPECT_EQ(bytes, decoded);
+  }
+}
+
+TEST(HexTest, DecodeUpperCase) {
+  unsigned char out[4];
+  EXPECT_TRUE(HexDecode("DeadBEEF", 4, out));
+  EXPECT_EQ(0xde, out[0]);
+  EXPECT_EQ(0xad, out[1]);
+  EXPECT_EQ(0xbe, out[2]);
+  EXPECT_EQ(0xef, out[3]);
+}
+
+TEST(HexTest, DecodeRejectsInvalidCharacters) {
+  const size_t kSize = 40;
+  const string valid = ReferenceHex(Bytes(kSize));
+  string out(kSize, '\0');
+  for (char bad : {'g', 'G', ' ', '/', ':', '@', '`', '\0', '\xff'}) {
+    for (size_t pos = 0; pos < valid.size(); pos++) {
+      string hex = valid;
+      hex[pos] = bad;
+      EXPECT_FALSE(HexDecode(hex.data(), kSize, &out[0]))
+          << "char: " << static_cast<int>(bad) << " at " << pos;
+    }
+  }
+}
+
+}  // namespace vobla
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "vobla/histogram.h"
+#include "vobla/shard_internal.h"
+#include "vobla/timer.h"
+
+namespace vobla {
+
+namespace {
+
+/// Each power of two is split into 2^kSubBucketBits buckets.
+const int kSubBucketBits = 6;
+const int kSubBuckets = 1 << kSubBucketBits;
+
+/// Values below kSubBuckets have a bucket each; each of the other 57 powers
+/// of two in the int64 range has kSubBuckets.
+constexpr int kBuckets = (64 - kSubBucketBits) * kSubBuckets;
+
+using shard_internal::kNoMin;
+const int64_t kNoMax = -1;
+
+}  // anonymous namespace
+
+const int HistogramSnapshot::kNumBuckets = kBuckets;
+
+// static
+int HistogramSnapshot::BucketOf(int64_t value) {
+  if (value < kSubBuckets) {
+    return value < 0 ? 0 : static_cast<int>(value);
+  }
+  int exponent = 63 - __builtin_clzll(value);
+  int shift = exponent - kSubBucketBits;
+  return (shift + 1) * kSubBuckets +
+      static_cast<int>((value >> shift) & (kSubBuckets - 1));
+}
+
+// static
+int64_t HistogramSnapshot::BucketLowerBound(int index) {
+  int group = index / kSubBuckets;
+  uint64_t sub = index % kSubBuckets;
+  if (group == 0) {
+    return sub;
+  }
+  return static_cast<int64_t>((kSubBuckets + sub) << (group - 1));
+}
+
+// static
+int64_t HistogramSnapshot::BucketUpperBound(int index) {
+  int group = index / kSubBuckets;
+  if (group == 0) {
+    return index;
+  }
+  return static_cast<int64_t>(
+      static_cast<uint64_t>(BucketLowerBound(index)) +
+      (uint64_t(1) << (group - 1)) - 1);
+}
+
+HistogramSnapshot::HistogramSnapshot()
+    : buckets_(kBuckets), min_(kNoMin), max_(kNoMax) {
+}
+
+void HistogramSnapshot::Merge(const HistogramSnapshot& other) {
+  for (int i = 0; i < kBuckets; i++) {
+    buckets_[i] += other.buckets_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+double HistogramSnapshot::mean() const {
+  return count_ ? sum_ / count_ : 0;
+}
+
+int64_t HistogramSnapshot::Percentile(double percentile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  if (percentile <= 0) {
+    return min_;
+  }
+  percentile = std::min(percentile, 100.0);
+  uint64_t rank = static_cast<uint64_t>(std::ceil(percentile / 100 * count_));
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return std::max(min_, std::min(BucketUpperBound(i), max_));
+    }
+  }
+  return max_;
+}
+
+// ---- LatencyHistogram ----
+
+struct LatencyHistogram::Shard {
+  Shard() { Reset(); }
+
+  void Reset() {
+    for (auto& bucket : buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    sum_low.store(0, std::memory_order_relaxed);
+    sum_high.store(0, std::memory_order_relaxed);
+    min.store(kNoMin, std::memory_order_relaxed);
+    max.store(kNoMax, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> buckets[kBuckets];
+  /// The sum of the values as a 128-bit integer, so that it never
+  /// overflows: 'sum_high' counts the carries out of 'sum_low'.
+  std::atomic<uint64_t> sum_low;
+  std::atomic<uint64_t> sum_high;
+  std::atomic<int64_t> min;
+  std::atomic<int64_t> max;
+};
+
+LatencyHistogram::LatencyHistogram() {
+  for (auto& shard : shards_) {
+    shard.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+LatencyHistogram::~LatencyHistogram() {
+  for (auto& shard : shards_) {
+    delete shard.load(std::memory_order_relaxed);
+  }
+}
+
+LatencyHistogram::Shard* LatencyHistogram::GetShard() {
+  const int slot = shard_internal::ThreadShard(kNumShards);
+  Shard* shard = shards_[slot].load(std::memory_order_acquire);
+  if (shard) {
+    return shard;
+  }
+  std::unique_ptr<Shard> fresh(new Shard);
+  if (shards_[slot].compare_exchange_strong(shard, fresh.get(),
+                                            std::memory_order_acq_rel)) {
+    return fresh.release();
+  }
+  // Another thread installed the shard first.
+  return shard;
+}
+
+void LatencyHistogram::Record(int64_t value) {
+  value = std::max<int64_t>(value, 0);
+  Shard* shard = GetShard();
+  shard->buckets[HistogramSnapshot::BucketOf(value)].fetch_add(
+      1, std::memory_order_relaxed);
+  const uint64_t low = shard->sum_low.fetch_add(value,
+                                                std::memory_order_relaxed);
+  if (low + value < low) {
+    shard->sum_high.fetch_add(1, std::memory_order_relaxed);
+  }
+  shard_internal::AtomicStoreMin(&shard->min, value);
+  shard_internal::AtomicStoreMax(&shard->max, value);
+}
+
+void LatencyHistogram::Record(const TimerInterface& timer) {
+  Record(std::llround(timer.get_in_ms() * 1000));
+}
+
+HistogramSnapshot LatencyHistogram::Snapshot() const {
+  HistogramSnapshot snapshot;
+  for (const auto& slot : shards_) {
+    const Shard* shard = slot.load(std::memory_order_acquire);
+    if (!shard) {
+      continue;
+    }
+    for (int i = 0; i < kBuckets; i++) {
+      uint64_t n = shard->buckets[i].load(std::memory_order_relaxed);
+      snapshot.buckets_[i] += n;
+      snapshot.count_ += n;
+    }
+    snapshot.sum_ +=
+        std::ldexp(shard->sum_high.load(std::memory_order_relaxed), 64) +
+        shard->sum_low.load(std::memory_order_relaxed);
+    snapshot.min_ = std::min(snapshot.min_,
+                             shard->min.load(std::memory_order_relaxed));
+    snapshot.max_ = std::max(snapshot.max_,
+                             shard->max.load(std::memory_order_relaxed));
+  }
+  return snapshot;
+}
+
+void LatencyHistogram::Reset() {
+  for (auto& slot : shards_) {
+    Shard* shard = slot.load(std::memory_order_acquire);
+    if (shard) {
+      shard->Reset();
+    }
+  }
+}
+
+}  // namespace vobla
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VOBLA_HISTOGRAM_H_
+#define VOBLA_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <boost/utility.hpp>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "vobla/clock.h"
+
+namespace vobla {
+
+class TimerInterface;
+
+/**
+ * \class HistogramSnapshot
+ * \brief The recorded values of a LatencyHistogram at one point in time.
+ *
+ * Values are counted in log-linear buckets: each power of two is split into
+ * 64 equal buckets, so a reported value is within 1/64 (1.6%) of the
+ * recorded one, while the whole int64 range takes 3712 buckets. Snapshots
+ * of the same layout merge by adding counts, e.g. to combine hosts.
+ */
+class HistogramSnapshot {
+ public:
+  /// Constructs an empty snapshot.
+  HistogramSnapshot();
+
+  /// Adds the counts of 'other' to this snapshot.
+  void Merge(const HistogramSnapshot& other);
+
+  /// Returns the number of recorded values.
+  uint64_t count() const { return count_; }
+
+  /// Returns the smallest recorded value, or 0 if there is none.
+  int64_t min() const { return count_ ? min_ : 0; }
+
+  /// Returns the largest recorded value, or 0 if there is none.
+  int64_t max() const { return count_ ? max_ : 0; }
+
+  /// Returns the mean of the recorded values, or 0 if there is none.
+  double mean() const;
+
+  /**
+   * \brief Returns the value below or at which 'percentile' percent of the
+   * recorded values are, e.g. Percentile(99.9).
+   *
+   * The result is the largest value of the bucket holding that rank, capped
+   * by max(); Percentile(0) is min(). Returns 0 if the snapshot is empty.
+   */
+  int64_t Percentile(double percentile) const;
+
+  /// The number of buckets.
+  static const int kNumBuckets;
+
+  /// Returns the bucket counting 'value'. Negative values count as 0.
+  static int BucketOf(int64_t value);
+
+  /// Returns the smallest value counted by bucket 'index'.
+  static int64_t BucketLowerBound(int index);
+
+  /// Returns the largest value counted by bucket 'index'.
+  static int64_t BucketUpperBound(int index);
+
+ private:
+  friend class LatencyHistogram;
+
+  std::vector<uint64_t> buckets_;
+
+  uint64_t count_ = 0;
+
+  /// The sum of the recorded values, as a double to never overflow.
+  double sum_ = 0;
+
+  int64_t min_;
+
+  int64_t max_;
+};
+
+/**
+ * \class LatencyHistogram
+ * \brief A histogram of latencies that many threads record into without
+ * locking.
+ *
+ * Record() never locks: each thread adds to one of a fixed set of shards
+ * with relaxed atomic increments, and threads rarely share a shard. A shard
+ * is allocated on its first use. Snapshot() adds the shards up; it may run
+ * concurrently with Record() and then sees some of the concurrent values.
+ *
+ * Values are nanoseconds by convention, but any non-negative int64 works.
+ */
+class LatencyHistogram : boost::noncopyable {
+ public:
+  LatencyHistogram();
+
+  ~LatencyHistogram();
+
+  /// Records one value.
+  void Record(int64_t value);
+
+  /// Records the time measured by a stopped timer, in nanoseconds.
+  void Record(const TimerInterface& timer);
+
+  /// Returns the values recorded so far.
+  HistogramSnapshot Snapshot() const;
+
+  /// Forgets all values. Values recorded concurrently may be kept.
+  void Reset();
+
+ private:
+  struct Shard;
+
+  /// Up to this many threads record without sharing a shard.
+  static const int kNumShards = 16;
+
+  Shard* GetShard();
+
+  std::atomic<Shard*> shards_[kNumShards];
+};
+
+/**
+ * \class ScopedLatencyTimer
+ * \brief Records the lifetime of a scope into a LatencyHistogram.
+ *
+ * \code{.cpp}
+ * {
+ *   ScopedLatencyTimer timer(&rpc_latency);
+ *   HandleRequest();
+ * }
+ * \endcode
+ */
+class ScopedLatencyTimer : boost::noncopyable {
+ public:
+  /// Starts timing with 'clock'.
+  explicit ScopedLatencyTimer(LatencyHistogram* histogram,
+                              Clock* clock = Clock::monotonic_clock())
+      : histogram_(histogram), clock_(clock), start_ns_(clock->now_ns()) {
+  }
+
+  /// Records the time elapsed since construction.
+  ~ScopedLatencyTimer() {
+    histogram_->Record(clock_->now_ns() - start_ns_);
+  }
+
+ private:
+  LatencyHistogram* histogram_;
+
+  Clock* clock_;
+
+  int64_t start_ns_;
+};
+
+}  // namespace vobla
+
+#endif  // VOBLA_HISTOGRAM_H_
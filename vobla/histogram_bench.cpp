@@ -0,0 +1,70 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <mutex>
+#include <vector>
+#include "vobla/histogram.h"
+
+namespace vobla {
+
+namespace {
+
+LatencyHistogram* shared_histogram = new LatencyHistogram;
+
+/// Records from state.threads() threads into one histogram.
+void BM_Record(benchmark::State& state) {
+  int64_t value = state.thread_index() * 1000;
+  for (auto _ : state) {
+    shared_histogram->Record(value);
+    value = (value + 7919) & 0xfffff;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+/// The baseline: a histogram guarded by one mutex.
+void BM_LockedRecord(benchmark::State& state) {
+  static std::mutex mutex;
+  static std::vector<uint64_t> buckets(HistogramSnapshot::kNumBuckets);
+  int64_t value = state.thread_index() * 1000;
+  for (auto _ : state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    buckets[HistogramSnapshot::BucketOf(value)]++;
+    value = (value + 7919) & 0xfffff;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ScopedLatencyTimer(benchmark::State& state) {
+  for (auto _ : state) {
+    ScopedLatencyTimer timer(shared_histogram);
+  }
+}
+
+void BM_Snapshot(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(shared_histogram->Snapshot().Percentile(99));
+  }
+}
+
+}  // anonymous namespace
+
+BENCHMARK(BM_Record)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_LockedRecord)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_ScopedLatencyTimer);
+BENCHMARK(BM_Snapshot);
+
+}  // namespace vobla
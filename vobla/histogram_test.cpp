@@ -0,0 +1,117 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <limits>
+#include <thread>
+#include <vector>
+#include "vobla/clock.h"
+#include "vobla/histogram.h"
+
+namespace vobla {
+
+TEST(HistogramTest, Buckets) {
+  const int64_t values[] = {
+    0, 1, 63, 64, 65, 127, 128, 1000, 123456789,
+    std::numeric_limits<int64_t>::max(),
+  };
+  int prev = -1;
+  for (int64_t value : values) {
+    int bucket = HistogramSnapshot::BucketOf(value);
+    EXPECT_LT(bucket, HistogramSnapshot::kNumBuckets);
+    EXPECT_LE(prev, bucket);
+    EXPECT_LE(HistogramSnapshot::BucketLowerBound(bucket), value);
+    EXPECT_GE(HistogramSnapshot::BucketUpperBound(bucket), value);
+    // The bucket width is within 1/64 of the value.
+    EXPECT_LE(HistogramSnapshot::BucketUpperBound(bucket) -
+              HistogramSnapshot::BucketLowerBound(bucket), value / 64);
+    prev = bucket;
+  }
+  EXPECT_EQ(0, HistogramSnapshot::BucketOf(-5));
+  EXPECT_EQ(3712, HistogramSnapshot::kNumBuckets);
+  EXPECT_EQ(HistogramSnapshot::kNumBuckets - 1,
+            HistogramSnapshot::BucketOf(std::numeric_limits<int64_t>::max()));
+}
+
+TEST(HistogramTest, SumDoesNotOverflow) {
+  const int64_t kMax = std::numeric_limits<int64_t>::max();
+  LatencyHistogram histogram;
+  for (int i = 0; i < 4; i++) {
+    histogram.Record(kMax);
+  }
+  HistogramSnapshot snapshot = histogram.Snapshot();
+  EXPECT_EQ(4u, snapshot.count());
+  EXPECT_DOUBLE_EQ(static_cast<double>(kMax), snapshot.mean());
+}
+
+TEST(HistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(0, histogram.Snapshot().Percentile(99));
+  for (int64_t i = 1; i <= 10000; i++) {
+    histogram.Record(i * 1000);
+  }
+  HistogramSnapshot snapshot = histogram.Snapshot();
+  EXPECT_EQ(10000u, snapshot.count());
+  EXPECT_EQ(1000, snapshot.min());
+  EXPECT_EQ(10000000, snapshot.max());
+  EXPECT_DOUBLE_EQ(5000500, snapshot.mean());
+  EXPECT_NEAR(5000000, snapshot.Percentile(50), 5000000 / 64);
+  EXPECT_NEAR(9900000, snapshot.Percentile(99), 9900000 / 64);
+  EXPECT_NEAR(9990000, snapshot.Percentile(99.9), 9990000 / 64);
+  EXPECT_EQ(10000000, snapshot.Percentile(100));
+  EXPECT_EQ(1000, snapshot.Percentile(0));
+
+  histogram.Reset();
+  EXPECT_EQ(0u, histogram.Snapshot().count());
+}
+
+TEST(HistogramTest, ConcurrentRecordAndMerge) {
+  const int kThreads = 8;
+  const int kValues = 10000;
+  LatencyHistogram histogram;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&histogram, t] {
+      for (int i = 0; i < kValues; i++) {
+        histogram.Record(t * kValues + i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  HistogramSnapshot snapshot = histogram.Snapshot();
+  EXPECT_EQ(static_cast<uint64_t>(kThreads * kValues), snapshot.count());
+  EXPECT_EQ(0, snapshot.min());
+  EXPECT_EQ(kThreads * kValues - 1, snapshot.max());
+
+  snapshot.Merge(histogram.Snapshot());
+  EXPECT_EQ(static_cast<uint64_t>(2 * kThreads * kValues), snapshot.count());
+}
+
+TEST(HistogramTest, ScopedLatencyTimer) {
+  FakeClock clock;
+  LatencyHistogram histogram;
+  {
+    ScopedLatencyTimer timer(&histogram, &clock);
+    clock.advance(0.000002);
+  }
+  HistogramSnapshot snapshot = histogram.Snapshot();
+  EXPECT_EQ(1u, snapshot.count());
+  EXPECT_EQ(2000, snapshot.max());
+}
+
+}  // namespace vobla
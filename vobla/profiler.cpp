@@ -0,0 +1,299 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include "vobla/file_util.h"
+#include "vobla/gutil/demangle.h"
+#include "vobla/gutil/stringprintf.h"
+#include "vobla/profiler.h"
+
+using std::string;
+
+namespace vobla {
+
+namespace {
+
+/// The deepest stack kept, in frames.
+const int kMaxDepth = 64;
+
+/// The frames of the signal handler and the signal trampoline.
+const int kSkippedFrames = 2;
+
+/// The number of distinct stacks kept; a power of two.
+const size_t kTableSize = 4096;
+
+/// Slots probed before a sample is dropped.
+const size_t kMaxProbes = 64;
+
+struct StackEntry {
+  /// The hash of the stack and tag, or 0 if the entry is free.
+  std::atomic<uint64_t> hash;
+
+  /// Set once the claiming thread has filled the entry.
+  std::atomic<bool> ready;
+
+  std::atomic<uint64_t> count;
+
+  const char* tag;
+
+  int depth;
+
+  void* frames[kMaxDepth];
+};
+
+StackEntry* stack_table = nullptr;
+
+std::atomic<bool> profiling(false);
+
+std::atomic<uint64_t> samples(0);
+
+std::atomic<uint64_t> dropped(0);
+
+/// Serializes Start(), Stop(), Clear() and the exports.
+std::mutex control_mutex;
+
+bool timer_running = false;
+
+thread_local const char* thread_tag = nullptr;
+
+uint64_t HashStack(const char* tag, void* const* frames, int depth) {
+  // FNV-1a over the pointers.
+  uint64_t hash = 14695981039346656037ULL;
+  hash = (hash ^ reinterpret_cast<uintptr_t>(tag)) * 1099511628211ULL;
+  for (int i = 0; i < depth; i++) {
+    hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ULL;
+  }
+  return hash ? hash : 1;
+}
+
+/// Counts a sample without locking or allocating. backtrace() itself is not
+/// async-signal-safe: it runs the libgcc unwinder, which may take the
+/// dl_iterate_phdr() lock and deadlock if the signal interrupts dlopen() or
+/// dlclose(). Calling it once beforehand only keeps it from loading the
+/// unwinder, i.e. from allocating, within the handler.
+void ProfileHandler(int /* signum */, siginfo_t* /* info */, void* /* uc */) {
+  if (!profiling.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const int saved_errno = errno;
+  samples.fetch_add(1, std::memory_order_relaxed);
+  void* frames[kMaxDepth + kSkippedFrames];
+  int depth = backtrace(frames, kMaxDepth + kSkippedFrames) - kSkippedFrames;
+  if (depth > 0) {
+    const char* tag = thread_tag;
+    void** stack = frames + kSkippedFrames;
+    const uint64_t hash = HashStack(tag, stack, depth);
+    size_t probe = 0;
+    for (; probe < kMaxProbes; probe++) {
+      StackEntry& entry = stack_table[(hash + probe) & (kTableSize - 1)];
+      uint64_t current = entry.hash.load(std::memory_order_relaxed);
+      if (current == 0 &&
+          entry.hash.compare_exchange_strong(current, hash,
+                                             std::memory_order_relaxed)) {
+        entry.tag = tag;
+        entry.depth = depth;
+        memcpy(entry.frames, stack, depth * sizeof(stack[0]));
+        entry.count.fetch_add(1, std::memory_order_relaxed);
+        entry.ready.store(true, std::memory_order_release);
+        break;
+      }
+      if (current == hash) {
+        entry.count.fetch_add(1, std::memory_order_relaxed);
+        break;
+      }
+    }
+    if (probe == kMaxProbes) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  errno = saved_errno;
+}
+
+/// Installs the handler and allocates the table, once.
+Status InstallHandler() {
+  if (stack_table) {
+    return Status::OK;
+  }
+  // Loads the unwinder outside of the handler; the first call allocates.
+  void* warmup[1];
+  backtrace(warmup, 1);
+
+  stack_table = new StackEntry[kTableSize];
+  for (size_t i = 0; i < kTableSize; i++) {
+    stack_table[i].hash.store(0, std::memory_order_relaxed);
+    stack_table[i].ready.store(false, std::memory_order_relaxed);
+    stack_table[i].count.store(0, std::memory_order_relaxed);
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = ProfileHandler;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, nullptr) != 0) {
+    return Status::system_error(errno);
+  }
+  return Status::OK;
+}
+
+/// Returns the name of the function containing 'pc'.
+string FrameName(void* pc, bool leaf) {
+  // Return addresses point past the call instruction.
+  void* lookup = leaf ? pc : static_cast<char*>(pc) - 1;
+  Dl_info info;
+  if (dladdr(lookup, &info) && info.dli_sname) {
+    string name = util::Demangle(info.dli_sname);
+    // ';' separates frames, and ' ' the count.
+    for (char& c : name) {
+      if (c == ';' || c == '\n') {
+        c = ',';
+      }
+    }
+    return name;
+  }
+  return StringPrintf("%p", pc);
+}
+
+}  // anonymous namespace
+
+// static
+const int Profiler::kDefaultFrequency;
+
+// static
+Status Profiler::Start(int frequency) {
+  if (frequency <= 0) {
+    return Status(-EINVAL, "Sampling frequency must be positive");
+  }
+  std::lock_guard<std::mutex> lock(control_mutex);
+  if (timer_running) {
+    return Status(-EBUSY, "The profiler has already started");
+  }
+  Status status = InstallHandler();
+  if (!status.ok()) {
+    return status;
+  }
+  profiling.store(true, std::memory_order_relaxed);
+  // ITIMER_PROF raises SIGPROF on the thread whose CPU time expired it,
+  // unlike a process CPU-time timer_create() timer, whose signal kernels
+  // before 6.4 deliver to the main thread.
+  const int64_t interval_us = std::max<int64_t>(1000000 / frequency, 1);
+  struct itimerval spec;
+  spec.it_interval.tv_sec = interval_us / 1000000;
+  spec.it_interval.tv_usec = interval_us % 1000000;
+  spec.it_value = spec.it_interval;
+  if (setitimer(ITIMER_PROF, &spec, nullptr) != 0) {
+    int saved_errno = errno;
+    profiling.store(false, std::memory_order_relaxed);
+    return Status::system_error(saved_errno);
+  }
+  timer_running = true;
+  return Status::OK;
+}
+
+// static
+void Profiler::Stop() {
+  std::lock_guard<std::mutex> lock(control_mutex);
+  if (!timer_running) {
+    return;
+  }
+  // A SIGPROF still pending afterwards finds profiling disabled.
+  profiling.store(false, std::memory_order_relaxed);
+  struct itimerval spec;
+  memset(&spec, 0, sizeof(spec));
+  setitimer(ITIMER_PROF, &spec, nullptr);
+  timer_running = false;
+}
+
+// static
+bool Profiler::enabled() {
+  return profiling.load(std::memory_order_relaxed);
+}
+
+// static
+void Profiler::Clear() {
+  std::lock_guard<std::mutex> lock(control_mutex);
+  if (stack_table) {
+    for (size_t i = 0; i < kTableSize; i++) {
+      stack_table[i].ready.store(false, std::memory_order_relaxed);
+      stack_table[i].count.store(0, std::memory_order_relaxed);
+      stack_table[i].hash.store(0, std::memory_order_release);
+    }
+  }
+  samples.store(0, std::memory_order_relaxed);
+  dropped.store(0, std::memory_order_relaxed);
+}
+
+// static
+uint64_t Profiler::num_samples() {
+  return samples.load(std::memory_order_relaxed);
+}
+
+// static
+uint64_t Profiler::num_dropped() {
+  return dropped.load(std::memory_order_relaxed);
+}
+
+// static
+string Profiler::FoldedStacks() {
+  // Stacks of different addresses in the same functions are merged.
+  std::map<string, uint64_t> stacks;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex);
+    for (size_t i = 0; stack_table && i < kTableSize; i++) {
+      const StackEntry& entry = stack_table[i];
+      if (!entry.ready.load(std::memory_order_acquire)) {
+        continue;
+      }
+      string folded = entry.tag ? entry.tag : "";
+      for (int frame = entry.depth - 1; frame >= 0; frame--) {
+        if (!folded.empty()) {
+          folded.push_back(';');
+        }
+        folded += FrameName(entry.frames[frame], frame == 0);
+      }
+      stacks[folded] += entry.count.load(std::memory_order_relaxed);
+    }
+  }
+  string output;
+  for (const auto& stack : stacks) {
+    StringAppendF(&output, "%s %llu\n", stack.first.c_str(),
+                  static_cast<unsigned long long>(stack.second));  // NOLINT
+  }
+  return output;
+}
+
+// static
+Status Profiler::WriteFoldedStacks(const string& path) {
+  return WriteStringToFile(path, FoldedStacks());
+}
+
+// static
+const char* Profiler::SetThreadTag(const char* tag) {
+  const char* previous = thread_tag;
+  thread_tag = tag;
+  return previous;
+}
+
+}  // namespace vobla
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file profiler.h
+ * \brief A sampling CPU profiler that exports folded stacks for flame graphs.
+ *
+ * \code{.cpp}
+ * Profiler::Start();
+ * {
+ *   VOBLA_TRACE_SPAN("Compaction");  // Samples are keyed on the span name.
+ *   ...
+ * }
+ * Profiler::Stop();
+ * Profiler::WriteFoldedStacks("/tmp/job.folded");
+ * // flamegraph.pl /tmp/job.folded > job.svg
+ * \endcode
+ */
+
+#ifndef VOBLA_PROFILER_H_
+#define VOBLA_PROFILER_H_
+
+#include <stdint.h>
+#include <string>
+#include "vobla/gutil/macros.h"
+#include "vobla/status.h"
+
+namespace vobla {
+
+/**
+ * \class Profiler
+ * \brief Samples the stacks of the running threads on SIGPROF.
+ *
+ * The ITIMER_PROF interval timer raises SIGPROF 'frequency' times per
+ * CPU-second of the process, on the thread that is running. The handler
+ * captures the interrupted stack and counts it in a fixed-size hash table
+ * without locking or allocating. Samples of a table that is full are
+ * dropped.
+ *
+ * A sample is keyed on its stack and on the innermost TraceSpan of its
+ * thread, which becomes the root frame of the folded stack.
+ *
+ * Once started, the SIGPROF handler stays installed, so it must not be used
+ * along with another user of SIGPROF or ITIMER_PROF, e.g. gperftools.
+ *
+ * Stacks are captured with backtrace(), which is not async-signal-safe: a
+ * sample that interrupts dlopen() or dlclose() may deadlock in the unwinder.
+ * Avoid profiling while loading or unloading shared libraries.
+ */
+class Profiler {
+ public:
+  /// The default sampling frequency, off-beat from periodic work.
+  static const int kDefaultFrequency = 99;
+
+  /**
+   * \brief Starts sampling, keeping the samples taken so far.
+   *
+   * \param frequency the number of samples per CPU-second.
+   * \return -EINVAL if 'frequency' is not positive, -EBUSY if already
+   * started, or the error of setting the timer.
+   */
+  static Status Start(int frequency = kDefaultFrequency);
+
+  /// Stops sampling. Samples are kept.
+  static void Stop();
+
+  static bool enabled();
+
+  /// Drops all samples. Must not be called while sampling.
+  static void Clear();
+
+  /// Returns the number of samples taken, including the dropped ones.
+  static uint64_t num_samples();
+
+  /// Returns the number of samples dropped because the table was full.
+  static uint64_t num_dropped();
+
+  /**
+   * \brief Returns the samples in the folded stack format, one stack per
+   * line from the root frame to the leaf, followed by its count:
+   * "span;main;Run;Compress 42".
+   *
+   * Frames are named by their demangled symbols, which needs the binary to
+   * be linked with -rdynamic; the others are named by their addresses.
+   */
+  static std::string FoldedStacks();
+
+  /// Writes FoldedStacks() to a file.
+  static Status WriteFoldedStacks(const std::string& path);
+
+ private:
+  friend class TraceSpan;
+
+  /// Sets the name that the samples of the calling thread are keyed on, or
+  /// nullptr; returns the previous one.
+  static const char* SetThreadTag(const char* tag);
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(Profiler);
+};
+
+}  // namespace vobla
+
+#endif  // VOBLA_PROFILER_H_
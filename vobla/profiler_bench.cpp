@@ -0,0 +1,57 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include "vobla/profiler.h"
+#include "vobla/trace.h"
+
+namespace vobla {
+
+namespace {
+
+/// A CPU-bound loop, run with the profiler sampling at state.range(0) Hz,
+/// or stopped if 0.
+void BM_ProfiledLoop(benchmark::State& state) {
+  Profiler::Clear();
+  if (state.range(0)) {
+    Profiler::Start(state.range(0));
+  }
+  uint64_t x = 1;
+  for (auto _ : state) {
+    for (int i = 0; i < 1000; i++) {
+      x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    benchmark::DoNotOptimize(x);
+  }
+  Profiler::Stop();
+  state.counters["samples"] = Profiler::num_samples();
+}
+
+/// A scoped span, which tags samples while the profiler runs.
+void BM_TaggedSpan(benchmark::State& state) {
+  Profiler::Start();
+  for (auto _ : state) {
+    VOBLA_TRACE_SPAN("span");
+  }
+  Profiler::Stop();
+}
+
+}  // anonymous namespace
+
+BENCHMARK(BM_ProfiledLoop)->Arg(0)->Arg(99)->Arg(1000);
+BENCHMARK(BM_TaggedSpan);
+
+}  // namespace vobla
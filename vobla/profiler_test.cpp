@@ -0,0 +1,136 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vobla/profiler.h"
+#include "vobla/trace.h"
+
+using std::string;
+
+namespace vobla {
+
+namespace {
+
+/// Burns about 'seconds' of CPU time.
+uint64_t __attribute__((noinline)) BurnCpu(double seconds) {
+  timespec start, now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+  uint64_t x = 1;
+  do {
+    for (int i = 0; i < 100000; i++) {
+      x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  } while ((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9
+           < seconds);
+  return x;
+}
+
+/// Returns the number of samples of the folded stacks under 'tag'.
+uint64_t CountTagged(const string& folded, const string& tag) {
+  std::istringstream lines(folded);
+  string line;
+  uint64_t count = 0;
+  while (std::getline(lines, line)) {
+    if (line.compare(0, tag.size() + 1, tag + ";") == 0) {
+      count += strtoull(line.c_str() + line.rfind(' ') + 1, nullptr, 10);
+    }
+  }
+  return count;
+}
+
+}  // anonymous namespace
+
+TEST(ProfilerTest, SamplesFoldedStacks) {
+  EXPECT_FALSE(Profiler::Start(0).ok());
+  Profiler::Clear();
+  ASSERT_TRUE(Profiler::Start(1000).ok());
+  EXPECT_TRUE(Profiler::enabled());
+  EXPECT_EQ(-EBUSY, Profiler::Start().error());
+  {
+    VOBLA_TRACE_SPAN("BurnCpu");
+    EXPECT_NE(0u, BurnCpu(0.3));
+  }
+  Profiler::Stop();
+  EXPECT_FALSE(Profiler::enabled());
+  const uint64_t samples = Profiler::num_samples();
+  // 300 expected; timers of virtual machines are coarse.
+  EXPECT_LT(50u, samples);
+  EXPECT_EQ(0u, Profiler::num_dropped());
+
+  // Sampling has stopped.
+  BurnCpu(0.05);
+  EXPECT_EQ(samples, Profiler::num_samples());
+
+  const string folded = Profiler::FoldedStacks();
+  std::istringstream lines(folded);
+  string line;
+  uint64_t total = 0, tagged = 0;
+  while (std::getline(lines, line)) {
+    size_t space = line.rfind(' ');
+    ASSERT_NE(string::npos, space) << line;
+    uint64_t count = strtoull(line.c_str() + space + 1, nullptr, 10);
+    EXPECT_LT(0u, count);
+    total += count;
+    if (line.compare(0, 8, "BurnCpu;") == 0) {
+      tagged += count;
+    }
+  }
+  EXPECT_EQ(samples, total);
+  // Most of the CPU time was spent within the span.
+  EXPECT_LT(samples / 2, tagged);
+
+  char path[] = "/tmp/vobla_profiler_test.XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_TRUE(Profiler::WriteFoldedStacks(path).ok());
+  std::ifstream file(path);
+  std::stringstream content;
+  content << file.rdbuf();
+  EXPECT_EQ(folded, content.str());
+  unlink(path);
+
+  Profiler::Clear();
+  EXPECT_EQ(0u, Profiler::num_samples());
+  EXPECT_EQ("", Profiler::FoldedStacks());
+}
+
+TEST(ProfilerTest, SamplesWorkerThreads) {
+  Profiler::Clear();
+  ASSERT_TRUE(Profiler::Start(1000).ok());
+  // The main thread idles in join() while the worker burns CPU.
+  std::thread worker([] {
+    VOBLA_TRACE_SPAN("Worker");
+    EXPECT_NE(0u, BurnCpu(0.3));
+  });
+  worker.join();
+  Profiler::Stop();
+  const uint64_t samples = Profiler::num_samples();
+  EXPECT_LT(50u, samples);
+  EXPECT_LT(samples / 2, CountTagged(Profiler::FoldedStacks(), "Worker"));
+  Profiler::Clear();
+}
+
+}  // namespace vobla
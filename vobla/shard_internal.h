@@ -0,0 +1,71 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file shard_internal.h
+ * \brief Helpers for statistics that threads update in per-thread shards.
+ * Not a public API.
+ */
+
+#ifndef VOBLA_SHARD_INTERNAL_H_
+#define VOBLA_SHARD_INTERNAL_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <limits>
+
+namespace vobla {
+namespace shard_internal {
+
+/// The initial minimum, larger than any value.
+const int64_t kNoMin = std::numeric_limits<int64_t>::max();
+
+/**
+ * \brief Returns the shard of the calling thread among 'num_shards'.
+ *
+ * Threads take shards round-robin, and a thread has the same shard in every
+ * sharded object, so up to 'num_shards' threads never share one.
+ */
+inline int ThreadShard(int num_shards) {
+  static std::atomic<int> next_thread(0);
+  static thread_local int thread_index =
+      next_thread.fetch_add(1, std::memory_order_relaxed);
+  return thread_index % num_shards;
+}
+
+/// Lowers 'target' to 'value' if it is smaller. New extremes are rare once
+/// a workload warms up, so the loop seldom repeats.
+inline void AtomicStoreMin(std::atomic<int64_t>* target, int64_t value) {
+  int64_t current = target->load(std::memory_order_relaxed);
+  while (value < current &&
+         !target->compare_exchange_weak(current, value,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+/// Raises 'target' to 'value' if it is larger.
+inline void AtomicStoreMax(std::atomic<int64_t>* target, int64_t value) {
+  int64_t current = target->load(std::memory_order_relaxed);
+  while (value > current &&
+         !target->compare_exchange_weak(current, value,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace shard_internal
+}  // namespace vobla
+
+#endif  // VOBLA_SHARD_INTERNAL_H_
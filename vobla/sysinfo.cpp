@@ -14,6 +14,9 @@
  * limitations under the License.
  */
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 #include <fcntl.h>
 #include <glog/logging.h>
 #if defined(linux) || defined(__linux__)
@@ -24,14 +27,22 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__)
 #include <sys/sysctl.h>
+#endif
 #include <sys/types.h>
 #include <unistd.h>
 #if defined(__APPLE__)
 #include <sys/disk.h>
 #include <libproc.h>
 #endif /* __APPLE__ */
+#include <algorithm>
+#include <map>
+#include <set>
 #include <string>
+#include <tuple>
+#include <vector>
+#include "vobla/clock.h"
 #include "vobla/gutil/stringprintf.h"
 #include "vobla/sysinfo.h"
 
@@ -113,18 +124,58 @@ int SysInfo::GetNumCpus() {
   return num_cpus;
 }
 
-/*
-inline uint64_t rdtsc() {
-  uint32_t lo, hi;
-  __asm__ __volatile__
-    ("rdtsc" : "=a"(lo), "=d"(hi));
-  return (uint64_t) hi << 32 | lo;
+namespace {
+
+/// Probes CPUID for the features listed in SysInfo::CpuFeature.
+uint32_t ProbeCpuFeatures() {
+  uint32_t features = 0;
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return 0;
+  }
+  if (ecx & bit_SSSE3) {
+    features |= 1 << SysInfo::SSSE3;
+  }
+  if (ecx & bit_SSE4_2) {
+    features |= 1 << SysInfo::SSE4_2;
+  }
+  if (ecx & bit_PCLMUL) {
+    features |= 1 << SysInfo::PCLMUL;
+  }
+  // AVX2 also requires the OS to save the YMM registers (OSXSAVE + XCR0).
+  bool os_saves_ymm = false;
+  if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__ __volatile__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    os_saves_ymm = (xcr0_lo & 0x6) == 0x6;
+  }
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    if ((ebx & bit_AVX2) && os_saves_ymm) {
+      features |= 1 << SysInfo::AVX2;
+    }
+    if (ebx & bit_SHA) {
+      features |= 1 << SysInfo::SHA;
+    }
+  }
+  // Extended feature leaf, EDX bit 27.
+  if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (edx & (1 << 27))) {
+    features |= 1 << SysInfo::RDTSCP;
+  }
+  // Advanced power management leaf, EDX bit 8.
+  if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1 << 8))) {
+    features |= 1 << SysInfo::INVARIANT_TSC;
+  }
+#endif
+  return features;
 }
 
-double get_cur_time(void) {
-  return rdtsc() / cpufreq_;
+}  // anonymous namespace
+
+bool SysInfo::HasCpuFeature(CpuFeature feature) {
+  static const uint32_t features = ProbeCpuFeatures();
+  return features & (1 << feature);
 }
-*/
 
 pid_t SysInfo::GetParentPid(pid_t pid) {
   if (pid == 0) {
@@ -198,4 +249,553 @@ int SysInfo::GetProcessName(pid_t pid, string* name) {
   return 0;
 }
 
+// ---- SystemMetrics ----
+
+SystemMetrics SystemMetrics::Delta(const SystemMetrics& before) const {
+  SystemMetrics delta = *this;
+  delta.timestamp_ns -= before.timestamp_ns;
+  delta.cpu.user -= before.cpu.user;
+  delta.cpu.nice -= before.cpu.nice;
+  delta.cpu.system -= before.cpu.system;
+  delta.cpu.idle -= before.cpu.idle;
+  delta.cpu.iowait -= before.cpu.iowait;
+  delta.cpu.irq -= before.cpu.irq;
+  delta.cpu.softirq -= before.cpu.softirq;
+  delta.cpu.steal -= before.cpu.steal;
+  delta.context_switches -= before.context_switches;
+  delta.processes_created -= before.processes_created;
+  delta.process_user_ticks -= before.process_user_ticks;
+  delta.process_system_ticks -= before.process_system_ticks;
+  delta.minor_faults -= before.minor_faults;
+  delta.major_faults -= before.major_faults;
+  delta.read_chars -= before.read_chars;
+  delta.write_chars -= before.write_chars;
+  delta.read_syscalls -= before.read_syscalls;
+  delta.write_syscalls -= before.write_syscalls;
+  delta.read_bytes -= before.read_bytes;
+  delta.write_bytes -= before.write_bytes;
+  return delta;
+}
+
+double SystemMetrics::SecondsSince(const SystemMetrics& before) const {
+  return (timestamp_ns - before.timestamp_ns) / 1e9;
+}
+
+double SystemMetrics::cpu_busy_fraction() const {
+  uint64_t total = cpu.total();
+  return total ? static_cast<double>(cpu.busy()) / total : 0;
+}
+
+double SystemMetrics::process_cpus() const {
+  if (timestamp_ns <= 0 || ticks_per_second <= 0) {
+    return 0;
+  }
+  double seconds = static_cast<double>(process_user_ticks +
+                                       process_system_ticks) /
+      ticks_per_second;
+  return seconds / (timestamp_ns / 1e9);
+}
+
+// ---- SystemMetricsCollector ----
+
+namespace {
+
+const char* const kProcFilePaths[] = {
+  "/proc/stat",
+  "/proc/meminfo",
+  "/proc/self/stat",
+  "/proc/self/io",
+};
+
+/// Fits /proc/stat of a few hundred CPUs; grown when it does not.
+const size_t kInitialBufferSize = 64 * 1024;
+
+/// Parses the decimal number at 'p', skipping spaces before it, and
+/// advances 'p' past it. Returns 0 if there is no number.
+uint64_t ParseNumber(const char** p, const char* end) {
+  const char* q = *p;
+  while (q < end && (*q == ' ' || *q == '\t')) {
+    q++;
+  }
+  uint64_t value = 0;
+  while (q < end && *q >= '0' && *q <= '9') {
+    value = value * 10 + (*q - '0');
+    q++;
+  }
+  *p = q;
+  return value;
+}
+
+/// Skips the next space-separated field.
+void SkipField(const char** p, const char* end) {
+  const char* q = *p;
+  while (q < end && *q == ' ') {
+    q++;
+  }
+  while (q < end && *q != ' ' && *q != '\n') {
+    q++;
+  }
+  *p = q;
+}
+
+/// Returns true if the line at 'line' starts with the literal 'prefix'.
+template <size_t N>
+bool StartsWith(const char* line, const char* end, const char (&prefix)[N]) {
+  return static_cast<size_t>(end - line) >= N - 1 &&
+      memcmp(line, prefix, N - 1) == 0;
+}
+
+/// Calls 'parse_line(begin, end)' for each line in [p, end).
+template <typename Function>
+void ForEachLine(const char* p, const char* end, Function parse_line) {
+  while (p < end) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (!eol) {
+      eol = end;
+    }
+    parse_line(p, eol);
+    p = eol + 1;
+  }
+}
+
+void ParseProcStat(const char* p, const char* end, SystemMetrics* metrics) {
+  ForEachLine(p, end, [metrics](const char* line, const char* eol) {
+    if (StartsWith(line, eol, "cpu ")) {
+      line += 4;
+      SystemMetrics::CpuTimes* cpu = &metrics->cpu;
+      cpu->user = ParseNumber(&line, eol);
+      cpu->nice = ParseNumber(&line, eol);
+      cpu->system = ParseNumber(&line, eol);
+      cpu->idle = ParseNumber(&line, eol);
+      cpu->iowait = ParseNumber(&line, eol);
+      cpu->irq = ParseNumber(&line, eol);
+      cpu->softirq = ParseNumber(&line, eol);
+      cpu->steal = ParseNumber(&line, eol);
+    } else if (StartsWith(line, eol, "ctxt ")) {
+      line += 5;
+      metrics->context_switches = ParseNumber(&line, eol);
+    } else if (StartsWith(line, eol, "processes ")) {
+      line += 10;
+      metrics->processes_created = ParseNumber(&line, eol);
+    } else if (StartsWith(line, eol, "procs_running ")) {
+      line += 14;
+      metrics->procs_running = ParseNumber(&line, eol);
+    } else if (StartsWith(line, eol, "procs_blocked ")) {
+      line += 14;
+      metrics->procs_blocked = ParseNumber(&line, eol);
+    }
+  });
+}
+
+void ParseMeminfo(const char* p, const char* end, SystemMetrics* metrics) {
+  struct Field {
+    const char* name;
+    size_t length;
+    uint64_t SystemMetrics::* member;
+  };
+  static const Field kFields[] = {
+    { "MemTotal:", 9, &SystemMetrics::mem_total },
+    { "MemFree:", 8, &SystemMetrics::mem_free },
+    { "MemAvailable:", 13, &SystemMetrics::mem_available },
+    { "Buffers:", 8, &SystemMetrics::buffers },
+    { "Cached:", 7, &SystemMetrics::cached },
+    { "SwapTotal:", 10, &SystemMetrics::swap_total },
+    { "SwapFree:", 9, &SystemMetrics::swap_free },
+  };
+  ForEachLine(p, end, [metrics](const char* line, const char* eol) {
+    for (const Field& field : kFields) {
+      if (static_cast<size_t>(eol - line) > field.length &&
+          memcmp(line, field.name, field.length) == 0) {
+        line += field.length;
+        // Values are in kB.
+        metrics->*field.member = ParseNumber(&line, eol) * 1024;
+        return;
+      }
+    }
+  });
+}
+
+void ParseSelfStat(const char* p, const char* end, int64_t page_size,
+                   SystemMetrics* metrics) {
+  // The command name in parentheses may contain spaces and parentheses.
+  const char* q = end;
+  while (q > p && q[-1] != ')') {
+    q--;
+  }
+  if (q == p) {
+    return;
+  }
+  // Fields are numbered from 1 as in proc(5); 'q' is before field 3.
+  for (int field = 3; field <= 24 && q < end; field++) {
+    switch (field) {
+      case 10:
+        metrics->minor_faults = ParseNumber(&q, end);
+        break;
+      case 12:
+        metrics->major_faults = ParseNumber(&q, end);
+        break;
+      case 14:
+        metrics->process_user_ticks = ParseNumber(&q, end);
+        break;
+      case 15:
+        metrics->process_system_ticks = ParseNumber(&q, end);
+        break;
+      case 20:
+        metrics->num_threads = ParseNumber(&q, end);
+        break;
+      case 23:
+        metrics->virtual_size = ParseNumber(&q, end);
+        break;
+      case 24:
+        metrics->resident_size = ParseNumber(&q, end) * page_size;
+        break;
+      default:
+        SkipField(&q, end);
+    }
+  }
+}
+
+void ParseSelfIo(const char* p, const char* end, SystemMetrics* metrics) {
+  ForEachLine(p, end, [metrics](const char* line, const char* eol) {
+    if (StartsWith(line, eol, "rchar: ")) {
+      line += 7;
+      metrics->read_chars = ParseNumber(&line, eol);
+    } else if (StartsWith(line, eol, "wchar: ")) {
+      line += 7;
+      metrics->write_chars = ParseNumber(&line, eol);
+    } else if (StartsWith(line, eol, "syscr: ")) {
+      line += 7;
+      metrics->read_syscalls = ParseNumber(&line, eol);
+    } else if (StartsWith(line, eol, "syscw: ")) {
+      line += 7;
+      metrics->write_syscalls = ParseNumber(&line, eol);
+    } else if (StartsWith(line, eol, "read_bytes: ")) {
+      line += 12;
+      metrics->read_bytes = ParseNumber(&line, eol);
+    } else if (StartsWith(line, eol, "write_bytes: ")) {
+      line += 13;
+      metrics->write_bytes = ParseNumber(&line, eol);
+    }
+  });
+}
+
+}  // anonymous namespace
+
+SystemMetricsCollector::SystemMetricsCollector()
+    : buffer_(kInitialBufferSize), ticks_per_second_(sysconf(_SC_CLK_TCK)),
+      page_size_(sysconf(_SC_PAGESIZE)) {
+  for (int i = 0; i < NUM_PROC_FILES; i++) {
+    fds_[i] = open(kProcFilePaths[i], O_RDONLY | O_CLOEXEC);
+    if (fds_[i] < 0) {
+      VLOG(1) << "Failed to open " << kProcFilePaths[i] << ": "
+              << strerror(errno);
+    }
+  }
+}
+
+SystemMetricsCollector::~SystemMetricsCollector() {
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+Status SystemMetricsCollector::Read(ProcFile file, size_t* size) {
+  while (true) {
+    ssize_t nread = pread(fds_[file], buffer_.data(), buffer_.size(), 0);
+    if (nread < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return Status::system_error(errno);
+    }
+    // procfs returns the whole file in one read when it fits.
+    if (static_cast<size_t>(nread) < buffer_.size()) {
+      *size = nread;
+      return Status::OK;
+    }
+    buffer_.resize(buffer_.size() * 2);
+  }
+}
+
+Status SystemMetricsCollector::Collect(SystemMetrics* metrics) {
+  CHECK_NOTNULL(metrics);
+  *metrics = SystemMetrics();
+  metrics->timestamp_ns = Clock::monotonic_clock()->now_ns();
+  metrics->ticks_per_second = ticks_per_second_;
+  bool any_open = false;
+  for (int i = 0; i < NUM_PROC_FILES; i++) {
+    if (fds_[i] < 0) {
+      continue;
+    }
+    any_open = true;
+    size_t size = 0;
+    Status status = Read(static_cast<ProcFile>(i), &size);
+    if (!status.ok()) {
+      return status;
+    }
+    const char* begin = buffer_.data();
+    const char* end = begin + size;
+    switch (i) {
+      case PROC_STAT:
+        ParseProcStat(begin, end, metrics);
+        break;
+      case PROC_MEMINFO:
+        ParseMeminfo(begin, end, metrics);
+        break;
+      case PROC_SELF_STAT:
+        ParseSelfStat(begin, end, page_size_, metrics);
+        break;
+      case PROC_SELF_IO:
+        ParseSelfIo(begin, end, metrics);
+        break;
+    }
+  }
+  if (!any_open) {
+    return Status(-ENOENT, "No /proc file is readable");
+  }
+  return Status::OK;
+}
+
+// ---- CpuTopology ----
+
+namespace {
+
+/// Reads the first line of a sysfs file, without its newline.
+bool ReadSysfsLine(const string& path, string* line) {
+  char buffer[BUFSIZE];
+  FILE* fp = fopen(path.c_str(), "r");
+  if (!fp) {
+    return false;
+  }
+  bool success = fgets(buffer, BUFSIZE, fp) != nullptr;
+  fclose(fp);
+  if (success) {
+    *line = buffer;
+    while (!line->empty() && (line->back() == '\n' || line->back() == ' ')) {
+      line->pop_back();
+    }
+  }
+  return success;
+}
+
+/// Reads a sysfs file holding an integer; returns 'fallback' if it fails.
+int64_t ReadSysfsInt(const string& path, int64_t fallback) {
+  string line;
+  if (!ReadSysfsLine(path, &line) || line.empty()) {
+    return fallback;
+  }
+  char* end = nullptr;
+  int64_t value = strtoll(line.c_str(), &end, 10);
+  return end == line.c_str() ? fallback : value;
+}
+
+/// Parses a CPU list like "0-3,8,10-11" into sorted ids.
+bool ParseCpuList(const string& list, std::vector<int>* cpus) {
+  cpus->clear();
+  const char* p = list.c_str();
+  while (*p) {
+    char* end = nullptr;
+    long first = strtol(p, &end, 10);  // NOLINT
+    if (end == p || first < 0) {
+      return false;
+    }
+    long last = first;  // NOLINT
+    p = end;
+    if (*p == '-') {
+      last = strtol(p + 1, &end, 10);
+      if (end == p + 1 || last < first) {
+        return false;
+      }
+      p = end;
+    }
+    for (long cpu = first; cpu <= last; cpu++) {  // NOLINT
+      cpus->push_back(static_cast<int>(cpu));
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p) {
+      return false;
+    }
+  }
+  std::sort(cpus->begin(), cpus->end());
+  cpus->erase(std::unique(cpus->begin(), cpus->end()), cpus->end());
+  return true;
+}
+
+/// Parses a cache size like "48K" into bytes.
+size_t ParseCacheSize(const string& size) {
+  char* end = nullptr;
+  size_t bytes = strtoull(size.c_str(), &end, 10);
+  switch (*end) {
+    case 'K':
+      return bytes << 10;
+    case 'M':
+      return bytes << 20;
+    case 'G':
+      return bytes << 30;
+    default:
+      return bytes;
+  }
+}
+
+/// Reads the caches of a CPU into 'caches', skipping those already read
+/// from a CPU sharing them.
+void DiscoverCaches(const string& cpu_dir,
+                    std::vector<CpuTopology::Cache>* caches) {
+  for (int index = 0;; index++) {
+    const string dir = StringPrintf("%s/cache/index%d", cpu_dir.c_str(), index);
+    string type, size, shared;
+    if (!ReadSysfsLine(dir + "/type", &type)) {
+      break;
+    }
+    CpuTopology::Cache cache;
+    cache.level = ReadSysfsInt(dir + "/level", 0);
+    if (type == "Data") {
+      cache.type = CpuTopology::DATA_CACHE;
+    } else if (type == "Instruction") {
+      cache.type = CpuTopology::INSTRUCTION_CACHE;
+    } else {
+      cache.type = CpuTopology::UNIFIED_CACHE;
+    }
+    if (ReadSysfsLine(dir + "/size", &size)) {
+      cache.size = ParseCacheSize(size);
+    }
+    cache.line_size = ReadSysfsInt(dir + "/coherency_line_size", 0);
+    if (ReadSysfsLine(dir + "/shared_cpu_list", &shared)) {
+      ParseCpuList(shared, &cache.shared_cpus);
+    }
+    bool known = false;
+    for (const auto& other : *caches) {
+      if (other.level == cache.level && other.type == cache.type &&
+          other.shared_cpus == cache.shared_cpus) {
+        known = true;
+        break;
+      }
+    }
+    if (!known) {
+      caches->push_back(cache);
+    }
+  }
+}
+
+/// Returns the first data or unified cache of a level.
+const CpuTopology::Cache* FindCache(const CpuTopology& topology, int level) {
+  for (const auto& cache : topology.caches) {
+    if (cache.level == level && cache.type != CpuTopology::INSTRUCTION_CACHE) {
+      return &cache;
+    }
+  }
+  return nullptr;
+}
+
+}  // anonymous namespace
+
+size_t CpuTopology::cache_size(int level) const {
+  const Cache* cache = FindCache(*this, level);
+  return cache ? cache->size : 0;
+}
+
+size_t CpuTopology::cache_line_size(int level) const {
+  const Cache* cache = FindCache(*this, level);
+  return cache ? cache->line_size : 0;
+}
+
+int CpuTopology::cache_sharing(int level) const {
+  const Cache* cache = FindCache(*this, level);
+  return cache ? static_cast<int>(cache->shared_cpus.size()) : 0;
+}
+
+// static
+Status CpuTopology::Discover(const string& root, CpuTopology* topology) {
+  CHECK_NOTNULL(topology);
+  *topology = CpuTopology();
+  string line;
+  std::vector<int> online;
+  Status status;
+  if (!ReadSysfsLine(root + "/cpu/online", &line) ||
+      !ParseCpuList(line, &online)) {
+    status = Status(-ENOENT, "Can not read " + root + "/cpu/online");
+    online.clear();
+    for (int cpu = 0; cpu < std::max(SysInfo::GetNumCpus(), 1); cpu++) {
+      online.push_back(cpu);
+    }
+  }
+
+  // Physical cores are identified by (socket, core id).
+  std::map<std::pair<int, int>, int> core_indexes;
+  std::set<int> sockets;
+  for (int id : online) {
+    const string dir = StringPrintf("%s/cpu/cpu%d", root.c_str(), id);
+    Cpu cpu;
+    cpu.id = id;
+    cpu.socket = ReadSysfsInt(dir + "/topology/physical_package_id", 0);
+    // Without a topology, each CPU is its own core.
+    int core_id = ReadSysfsInt(dir + "/topology/core_id", -1 - id);
+    auto inserted = core_indexes.insert(std::make_pair(
+        std::make_pair(cpu.socket, core_id),
+        static_cast<int>(core_indexes.size())));
+    cpu.core = inserted.first->second;
+    sockets.insert(cpu.socket);
+    DiscoverCaches(dir, &topology->caches);
+    topology->cpus.push_back(cpu);
+  }
+  topology->num_sockets = sockets.size();
+  topology->num_cores = core_indexes.size();
+  for (Cpu& cpu : topology->cpus) {
+    for (const Cpu& other : topology->cpus) {
+      if (other.core == cpu.core) {
+        cpu.smt_siblings.push_back(other.id);
+      }
+    }
+  }
+  std::stable_sort(topology->caches.begin(), topology->caches.end(),
+                   [](const Cache& a, const Cache& b) {
+                     return a.level < b.level;
+                   });
+
+  std::vector<int> nodes;
+  if (ReadSysfsLine(root + "/node/online", &line) &&
+      ParseCpuList(line, &nodes)) {
+    for (int id : nodes) {
+      Node node;
+      node.id = id;
+      if (!ReadSysfsLine(StringPrintf("%s/node/node%d/cpulist",
+                                      root.c_str(), id), &line) ||
+          !ParseCpuList(line, &node.cpus) || node.cpus.empty()) {
+        // Memory-only nodes.
+        continue;
+      }
+      for (Cpu& cpu : topology->cpus) {
+        if (std::binary_search(node.cpus.begin(), node.cpus.end(), cpu.id)) {
+          cpu.node = id;
+        }
+      }
+      topology->nodes.push_back(node);
+    }
+  }
+  if (topology->nodes.empty()) {
+    Node node;
+    for (const Cpu& cpu : topology->cpus) {
+      node.cpus.push_back(cpu.id);
+    }
+    topology->nodes.push_back(node);
+  }
+  return status;
+}
+
+// static
+const CpuTopology& SysInfo::GetCpuTopology() {
+  static const CpuTopology* topology = [] {
+    CpuTopology* discovered = new CpuTopology;
+    Status status = CpuTopology::Discover("/sys/devices/system", discovered);
+    if (!status.ok()) {
+      VLOG(1) << "Failed to discover the CPU topology: " << status.message();
+    }
+    return discovered;
+  }();
+  return *topology;
+}
+
 }  // namespace vobla
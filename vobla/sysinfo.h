@@ -17,17 +17,45 @@
 #ifndef VOBLA_SYSINFO_H_
 #define VOBLA_SYSINFO_H_
 
+#include <stdint.h>
 #include <sys/types.h>
+#include <boost/utility.hpp>
 #include <string>
+#include <vector>
 #include "vobla/gutil/macros.h"
+#include "vobla/status.h"
 
 namespace vobla {
 
+struct CpuTopology;
+
 /**
  * \brief A portable way to obtain system information.
  */
 class SysInfo {
  public:
+  /// Instruction set extensions that vobla dispatches on at runtime.
+  enum CpuFeature {
+    SSSE3,
+    SSE4_2,
+    PCLMUL,
+    AVX2,
+    SHA,
+    /// The rdtscp instruction.
+    RDTSCP,
+    /// A time stamp counter that ticks at a constant rate in all P-, C- and
+    /// T-states, so it measures wall time.
+    INVARIANT_TSC,
+  };
+
+  /**
+   * \brief Returns true if the running CPU supports the given feature.
+   *
+   * The CPUID probe runs once; later calls only read the cached result.
+   * Always returns false on non-x86 platforms.
+   */
+  static bool HasCpuFeature(CpuFeature feature);
+
   /// Gets CPU frequency.
   static double GetCpuFrequency();
 
@@ -51,10 +79,228 @@ class SysInfo {
    */
   static int GetProcessName(pid_t pid, std::string* name);
 
+  /**
+   * \brief Returns the CPU, NUMA node and cache topology of the machine.
+   *
+   * It is discovered from /sys on the first call and never changes, so CPUs
+   * brought online later are missing.
+   */
+  static const CpuTopology& GetCpuTopology();
+
  private:
   DISALLOW_IMPLICIT_CONSTRUCTORS(SysInfo);
 };
 
+/**
+ * \brief The sockets, cores, SMT threads, NUMA nodes and caches of the
+ * online CPUs, e.g. to place threads and size per-core buffers.
+ *
+ * CPU sets are sorted lists of logical CPU ids, as taken by CPU_SET().
+ */
+struct CpuTopology {
+  /// A logical CPU, i.e. a hardware thread.
+  struct Cpu {
+    int id = 0;
+    /// The physical package.
+    int socket = 0;
+    /// The physical core, numbered across all sockets from 0.
+    int core = 0;
+    /// The NUMA node, 0 if unknown.
+    int node = 0;
+    /// The CPUs sharing this CPU's core, including itself.
+    std::vector<int> smt_siblings;
+  };
+
+  struct Node {
+    int id = 0;
+    std::vector<int> cpus;
+  };
+
+  enum CacheType {
+    DATA_CACHE,
+    INSTRUCTION_CACHE,
+    UNIFIED_CACHE,
+  };
+
+  /// One cache, shared by one or more CPUs.
+  struct Cache {
+    int level = 0;
+    CacheType type = UNIFIED_CACHE;
+    /// In bytes.
+    size_t size = 0;
+    size_t line_size = 0;
+    std::vector<int> shared_cpus;
+  };
+
+  /// The online CPUs, ordered by id.
+  std::vector<Cpu> cpus;
+
+  /// The NUMA nodes having CPUs, ordered by id. A machine without NUMA has
+  /// one node.
+  std::vector<Node> nodes;
+
+  /// Every cache instance, ordered by level.
+  std::vector<Cache> caches;
+
+  int num_sockets = 0;
+
+  /// The number of physical cores.
+  int num_cores = 0;
+
+  /// Returns the size of the level 'level' data or unified cache of a CPU,
+  /// or 0 if unknown.
+  size_t cache_size(int level) const;
+
+  /// Returns the line size of the level 'level' data or unified cache, or 0
+  /// if unknown.
+  size_t cache_line_size(int level) const;
+
+  /// Returns the number of CPUs sharing the level 'level' data or unified
+  /// cache, or 0 if unknown.
+  int cache_sharing(int level) const;
+
+  /**
+   * \brief Discovers the topology from a sysfs tree.
+   *
+   * \param root the directory holding cpu/ and node/, normally
+   * "/sys/devices/system".
+   * \return -ENOENT if root/cpu/online is missing, in which case the online
+   * CPUs are assumed to be separate cores of one socket.
+   */
+  static Status Discover(const std::string& root, CpuTopology* topology);
+};
+
+/**
+ * \brief A snapshot of the system and process counters in /proc.
+ *
+ * Counters only grow; Delta() turns two snapshots into the activity in
+ * between. Fields of a file that cannot be read stay 0.
+ */
+struct SystemMetrics {
+  /// The CPU time of all CPUs from /proc/stat, in clock ticks.
+  struct CpuTimes {
+    uint64_t user = 0;
+    uint64_t nice = 0;
+    uint64_t system = 0;
+    uint64_t idle = 0;
+    uint64_t iowait = 0;
+    uint64_t irq = 0;
+    uint64_t softirq = 0;
+    uint64_t steal = 0;
+
+    uint64_t total() const {
+      return user + nice + system + idle + iowait + irq + softirq + steal;
+    }
+
+    /// The ticks not spent idle or waiting for I/O.
+    uint64_t busy() const { return total() - idle - iowait; }
+  };
+
+  /// When the snapshot was taken, on Clock::monotonic_clock().
+  int64_t timestamp_ns = 0;
+
+  /// The length of a clock tick is 1 / ticks_per_second.
+  int64_t ticks_per_second = 0;
+
+  // ---- /proc/stat ----
+  CpuTimes cpu;
+  uint64_t context_switches = 0;
+  uint64_t processes_created = 0;
+  /// Gauges.
+  uint64_t procs_running = 0;
+  uint64_t procs_blocked = 0;
+
+  // ---- /proc/meminfo, gauges in bytes ----
+  uint64_t mem_total = 0;
+  uint64_t mem_free = 0;
+  uint64_t mem_available = 0;
+  uint64_t buffers = 0;
+  uint64_t cached = 0;
+  uint64_t swap_total = 0;
+  uint64_t swap_free = 0;
+
+  // ---- /proc/self/stat ----
+  /// The CPU time of this process, in clock ticks.
+  uint64_t process_user_ticks = 0;
+  uint64_t process_system_ticks = 0;
+  uint64_t minor_faults = 0;
+  uint64_t major_faults = 0;
+  /// Gauges; the sizes are in bytes.
+  uint64_t num_threads = 0;
+  uint64_t virtual_size = 0;
+  uint64_t resident_size = 0;
+
+  // ---- /proc/self/io, in bytes ----
+  /// Bytes passed to read() and write()-like calls, including cached I/O.
+  uint64_t read_chars = 0;
+  uint64_t write_chars = 0;
+  uint64_t read_syscalls = 0;
+  uint64_t write_syscalls = 0;
+  /// Bytes fetched from and sent to the storage layer.
+  uint64_t read_bytes = 0;
+  uint64_t write_bytes = 0;
+
+  /**
+   * \brief Returns the activity from 'before' to this snapshot: counters
+   * are subtracted, while gauges are the ones of this snapshot.
+   */
+  SystemMetrics Delta(const SystemMetrics& before) const;
+
+  /// Returns the seconds since 'before'.
+  double SecondsSince(const SystemMetrics& before) const;
+
+  /// On a Delta(), returns the fraction of the CPU time of all CPUs that
+  /// was busy, in [0, 1].
+  double cpu_busy_fraction() const;
+
+  /// On a Delta(), returns the number of CPUs this process kept busy.
+  double process_cpus() const;
+};
+
+/**
+ * \class SystemMetricsCollector
+ * \brief Samples SystemMetrics cheaply enough to run every second.
+ *
+ * The /proc files stay open and are re-read from offset 0 with pread(),
+ * then parsed in place, so Collect() neither opens files nor allocates
+ * once its buffer fits /proc/stat. It is not thread-safe.
+ */
+class SystemMetricsCollector : boost::noncopyable {
+ public:
+  /// Opens the /proc files. Files that fail to open are skipped.
+  SystemMetricsCollector();
+
+  ~SystemMetricsCollector();
+
+  /**
+   * \brief Takes a snapshot.
+   *
+   * \return -ENOENT if none of the files is open, or the error of reading
+   * a file, in which case 'metrics' is partially filled.
+   */
+  Status Collect(SystemMetrics* metrics);
+
+ private:
+  enum ProcFile {
+    PROC_STAT,
+    PROC_MEMINFO,
+    PROC_SELF_STAT,
+    PROC_SELF_IO,
+    NUM_PROC_FILES,
+  };
+
+  /// Reads a whole file into buffer_; sets 'size' to its length.
+  Status Read(ProcFile file, size_t* size);
+
+  int fds_[NUM_PROC_FILES];
+
+  std::vector<char> buffer_;
+
+  int64_t ticks_per_second_;
+
+  int64_t page_size_;
+};
+
 }  // namespace vobla
 
 #endif  // VOBLA_SYSINFO_H_
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <stdio.h>
+#include <string.h>
+#include "vobla/sysinfo.h"
+
+namespace vobla {
+
+namespace {
+
+void BM_Collect(benchmark::State& state) {
+  SystemMetricsCollector collector;
+  SystemMetrics metrics;
+  for (auto _ : state) {
+    collector.Collect(&metrics);
+    benchmark::DoNotOptimize(metrics.cpu.user);
+  }
+}
+
+/// The baseline: opening and scanning the same files with stdio.
+void BM_CollectWithStdio(benchmark::State& state) {
+  const char* const paths[] = {
+    "/proc/stat", "/proc/meminfo", "/proc/self/stat", "/proc/self/io",
+  };
+  char line[4096];
+  unsigned long long value = 0;  // NOLINT
+  for (auto _ : state) {
+    for (const char* path : paths) {
+      FILE* fp = fopen(path, "r");
+      if (!fp) {
+        continue;
+      }
+      while (fgets(line, sizeof(line), fp)) {
+        char name[64];
+        sscanf(line, "%63s %llu", name, &value);  // NOLINT
+      }
+      fclose(fp);
+    }
+    benchmark::DoNotOptimize(value);
+  }
+}
+
+}  // anonymous namespace
+
+BENCHMARK(BM_Collect);
+BENCHMARK(BM_CollectWithStdio);
+
+}  // namespace vobla
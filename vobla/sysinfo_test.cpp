@@ -0,0 +1,197 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "vobla/sysinfo.h"
+
+using std::string;
+
+namespace vobla {
+
+namespace {
+
+/// Writes 'content' to root/path, creating its directories.
+void WriteSysfsFile(const string& root, const string& path,
+                    const string& content) {
+  for (size_t slash = path.find('/'); slash != string::npos;
+       slash = path.find('/', slash + 1)) {
+    mkdir((root + "/" + path.substr(0, slash)).c_str(), 0755);
+  }
+  std::ofstream file(root + "/" + path);
+  file << content << "\n";
+}
+
+}  // anonymous namespace
+
+TEST(SysInfoTest, GetNumCpus) {
+  EXPECT_LE(1, SysInfo::GetNumCpus());
+}
+
+TEST(CpuTopologyTest, DiscoverFromSysfs) {
+  // 2 sockets x 2 cores x 2 threads, one NUMA node per socket, and a
+  // memory-only node 2. CPU n and n + 4 are siblings.
+  char root_template[] = "/tmp/vobla_sysfs_test.XXXXXX";
+  ASSERT_TRUE(mkdtemp(root_template));
+  const string root = root_template;
+  WriteSysfsFile(root, "cpu/online", "0-7");
+  for (int cpu = 0; cpu < 8; cpu++) {
+    const string dir = "cpu/cpu" + std::to_string(cpu);
+    const int socket = (cpu % 4) / 2;
+    WriteSysfsFile(root, dir + "/topology/physical_package_id",
+                   std::to_string(socket));
+    WriteSysfsFile(root, dir + "/topology/core_id", std::to_string(cpu % 2));
+    const string core_cpus = std::to_string(cpu % 4) + "," +
+        std::to_string(cpu % 4 + 4);
+    const string socket_cpus = socket ? "2-3,6-7" : "0-1,4-5";
+    const char* types[] = {"Data", "Instruction", "Unified", "Unified"};
+    const char* sizes[] = {"48K", "32K", "2M", "30720K"};
+    for (int index = 0; index < 4; index++) {
+      const string cache = dir + "/cache/index" + std::to_string(index);
+      WriteSysfsFile(root, cache + "/level",
+                     std::to_string(index < 2 ? 1 : index));
+      WriteSysfsFile(root, cache + "/type", types[index]);
+      WriteSysfsFile(root, cache + "/size", sizes[index]);
+      WriteSysfsFile(root, cache + "/coherency_line_size", "64");
+      WriteSysfsFile(root, cache + "/shared_cpu_list",
+                     index < 3 ? core_cpus : socket_cpus);
+    }
+  }
+  WriteSysfsFile(root, "node/online", "0-2");
+  WriteSysfsFile(root, "node/node0/cpulist", "0-1,4-5");
+  WriteSysfsFile(root, "node/node1/cpulist", "2-3,6-7");
+  WriteSysfsFile(root, "node/node2/cpulist", "");
+
+  CpuTopology topology;
+  ASSERT_TRUE(CpuTopology::Discover(root, &topology).ok());
+  ASSERT_EQ(8u, topology.cpus.size());
+  EXPECT_EQ(2, topology.num_sockets);
+  EXPECT_EQ(4, topology.num_cores);
+  EXPECT_EQ(6, topology.cpus[6].id);
+  EXPECT_EQ(1, topology.cpus[6].socket);
+  EXPECT_EQ(1, topology.cpus[6].node);
+  EXPECT_EQ(topology.cpus[2].core, topology.cpus[6].core);
+  EXPECT_NE(topology.cpus[2].core, topology.cpus[3].core);
+  EXPECT_EQ(std::vector<int>({2, 6}), topology.cpus[6].smt_siblings);
+
+  ASSERT_EQ(2u, topology.nodes.size());
+  EXPECT_EQ(1, topology.nodes[1].id);
+  EXPECT_EQ(std::vector<int>({2, 3, 6, 7}), topology.nodes[1].cpus);
+
+  // L1d, L1i and L2 per core, L3 per socket.
+  EXPECT_EQ(4u * 3 + 2, topology.caches.size());
+  EXPECT_EQ(48u << 10, topology.cache_size(1));
+  EXPECT_EQ(2u << 20, topology.cache_size(2));
+  EXPECT_EQ(30u << 20, topology.cache_size(3));
+  EXPECT_EQ(0u, topology.cache_size(4));
+  EXPECT_EQ(64u, topology.cache_line_size(1));
+  EXPECT_EQ(2, topology.cache_sharing(2));
+  EXPECT_EQ(4, topology.cache_sharing(3));
+
+  EXPECT_EQ(0, system(("rm -rf " + root).c_str()));
+
+  // Without sysfs, each CPU is a core of one socket and node.
+  EXPECT_EQ(-ENOENT, CpuTopology::Discover(root, &topology).error());
+  EXPECT_EQ(SysInfo::GetNumCpus(), static_cast<int>(topology.cpus.size()));
+  EXPECT_EQ(1, topology.num_sockets);
+  EXPECT_EQ(topology.num_cores, static_cast<int>(topology.cpus.size()));
+  ASSERT_EQ(1u, topology.nodes.size());
+  EXPECT_EQ(topology.cpus.size(), topology.nodes[0].cpus.size());
+}
+
+TEST(CpuTopologyTest, GetCpuTopology) {
+  const CpuTopology& topology = SysInfo::GetCpuTopology();
+  EXPECT_EQ(&topology, &SysInfo::GetCpuTopology());
+  EXPECT_EQ(SysInfo::GetNumCpus(), static_cast<int>(topology.cpus.size()));
+  EXPECT_LE(1, topology.num_sockets);
+  EXPECT_LE(topology.num_sockets, topology.num_cores);
+  EXPECT_LE(topology.num_cores, static_cast<int>(topology.cpus.size()));
+  EXPECT_LE(1u, topology.nodes.size());
+  size_t node_cpus = 0;
+  for (const auto& node : topology.nodes) {
+    node_cpus += node.cpus.size();
+  }
+  EXPECT_EQ(topology.cpus.size(), node_cpus);
+  for (const auto& cpu : topology.cpus) {
+    EXPECT_NE(cpu.smt_siblings.end(),
+              std::find(cpu.smt_siblings.begin(), cpu.smt_siblings.end(),
+                        cpu.id));
+  }
+  if (topology.cache_size(1)) {
+    EXPECT_LT(0u, topology.cache_line_size(1));
+    EXPECT_LE(topology.cache_size(1), topology.cache_size(2));
+  }
+}
+
+#if defined(__linux__)
+TEST(SystemMetricsTest, CollectAndDelta) {
+  SystemMetricsCollector collector;
+  SystemMetrics before;
+  ASSERT_TRUE(collector.Collect(&before).ok());
+  EXPECT_LT(0, before.timestamp_ns);
+  EXPECT_LT(0, before.ticks_per_second);
+  EXPECT_LT(0u, before.cpu.total());
+  EXPECT_LE(before.cpu.busy(), before.cpu.total());
+  EXPECT_LT(0u, before.context_switches);
+  EXPECT_LT(0u, before.processes_created);
+  EXPECT_LE(1u, before.procs_running);
+  EXPECT_LT(0u, before.mem_total);
+  EXPECT_LE(before.mem_free, before.mem_total);
+  EXPECT_LE(1u, before.num_threads);
+  EXPECT_LT(0u, before.resident_size);
+  EXPECT_LE(before.resident_size, before.virtual_size);
+
+  // Burns CPU, faults in pages and writes a file.
+  std::vector<char> pages(32 << 20, 1);
+  volatile uint64_t sum = 0;
+  for (int round = 0; round < 20; round++) {
+    for (size_t i = 0; i < pages.size(); i += 64) {
+      sum += pages[i];
+    }
+  }
+  char path[] = "/tmp/vobla_sysinfo_test.XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(4096, write(fd, pages.data(), 4096));
+  close(fd);
+  unlink(path);
+
+  SystemMetrics after;
+  ASSERT_TRUE(collector.Collect(&after).ok());
+  SystemMetrics delta = after.Delta(before);
+  EXPECT_EQ(after.timestamp_ns - before.timestamp_ns, delta.timestamp_ns);
+  EXPECT_NEAR(delta.timestamp_ns / 1e9, after.SecondsSince(before), 1e-9);
+  EXPECT_LE(before.cpu.total(), after.cpu.total());
+  // Transparent huge pages may fault the vector in with a few faults.
+  EXPECT_LT(0u, delta.minor_faults);
+  EXPECT_LE(4096u, delta.write_chars);
+  EXPECT_LE(1u, delta.write_syscalls);
+  // Gauges are kept.
+  EXPECT_EQ(after.mem_total, delta.mem_total);
+  EXPECT_EQ(after.resident_size, delta.resident_size);
+  EXPECT_LE(0, delta.cpu_busy_fraction());
+  EXPECT_GE(1, delta.cpu_busy_fraction());
+  EXPECT_LE(0, delta.process_cpus());
+}
+#endif  // __linux__
+
+}  // namespace vobla
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VOBLA_THREAD_POOL_H_
+#define VOBLA_THREAD_POOL_H_
+
+#include <boost/utility.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vobla {
+
+/**
+ * \class ThreadPool
+ * \brief A fixed-size pool of worker threads running tasks in FIFO order.
+ */
+class ThreadPool : boost::noncopyable {
+ public:
+  typedef std::function<void()> Task;
+
+  /// Returns a process-wide pool with one thread per logical CPU.
+  static ThreadPool* default_pool();
+
+  /// Starts 'num_threads' workers.
+  explicit ThreadPool(int num_threads);
+
+  /// Runs the remaining tasks and joins all workers.
+  ~ThreadPool();
+
+  /// Queues a task to run on one of the workers.
+  void Schedule(Task task);
+
+  /// Returns the number of worker threads.
+  int num_threads() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  void Run();
+
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+
+  std::condition_variable cond_;
+
+  std::deque<Task> tasks_;
+
+  bool stopping_ = false;
+};
+
+}  // namespace vobla
+
+#endif  // VOBLA_THREAD_POOL_H_
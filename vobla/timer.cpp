@@ -17,13 +17,24 @@
 #include <stddef.h>
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <time.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 #include "vobla/clock.h"
+#include "vobla/shard_internal.h"
+#include "vobla/sysinfo.h"
 #include "vobla/timer.h"
 
 namespace vobla {
 
 static double kMicroSecond = 1000000;
 
+static double kNanosPerMicroSecond = 1000;
+
 TimerInterface::~TimerInterface() {
 }
 
@@ -42,7 +53,7 @@ double get_delta_time(const timeval& start, const timeval& end) {
 }  // anonymous namespace
 
 //------ Timer -------
-Timer::Timer() : clock_(Clock::real_clock()) {
+Timer::Timer() : clock_(Clock::monotonic_clock()) {
 }
 
 Timer::Timer(Clock* clock) : clock_(clock) {
@@ -52,17 +63,162 @@ Timer::~Timer() {
 }
 
 void Timer::start() {
-  start_ = clock_->now();
+  start_ns_ = clock_->now_ns();
 }
 
 void Timer::stop() {
-  end_ = clock_->now();
+  end_ns_ = clock_->now_ns();
 }
 
 double Timer::get_in_ms() const {
-  return (end_ - start_) * kMicroSecond;
+  return get_in_ns() / kNanosPerMicroSecond;
+}
+
+int64_t Timer::get_in_ns() const {
+  return end_ns_ - start_ns_;
+}
+
+//------ CycleTimer -------
+namespace {
+
+uint64_t MonotonicNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+#if defined(__x86_64__)
+
+/// Reads the TSC after all earlier instructions have completed.
+inline uint64_t ReadTscBegin() {
+  _mm_lfence();
+  uint64_t tsc = __rdtsc();
+  _mm_lfence();
+  return tsc;
+}
+
+/// Reads the TSC, ordered like ReadTscBegin(). rdtscp itself waits for the
+/// earlier instructions.
+inline uint64_t ReadTscEnd(bool has_rdtscp) {
+  uint64_t tsc;
+  if (has_rdtscp) {
+    unsigned int aux;
+    tsc = __rdtscp(&aux);
+  } else {
+    _mm_lfence();
+    tsc = __rdtsc();
+  }
+  _mm_lfence();
+  return tsc;
+}
+
+/// Reads CLOCK_MONOTONIC together with the TSC values just around it.
+uint64_t ReadTscAndNanos(uint64_t* nanos) {
+  // The pair read with the least TSC ticks in between is the tightest.
+  uint64_t best_gap = ~0ULL;
+  uint64_t best_tsc = 0;
+  *nanos = 0;
+  for (int i = 0; i < 10; i++) {
+    uint64_t before = ReadTscBegin();
+    uint64_t ns = MonotonicNanos();
+    uint64_t after = ReadTscBegin();
+    if (after - before < best_gap) {
+      best_gap = after - before;
+      best_tsc = before + best_gap / 2;
+      *nanos = ns;
+    }
+  }
+  return best_tsc;
+}
+
+#endif  // __x86_64__
+
+/// How CycleTimer reads time, chosen once per process.
+struct CycleSource {
+  bool use_tsc = false;
+  bool has_rdtscp = false;
+  double cycles_per_ns = 1;
+
+  CycleSource() {
+#if defined(__x86_64__)
+    use_tsc = SysInfo::HasCpuFeature(SysInfo::INVARIANT_TSC);
+    has_rdtscp = SysInfo::HasCpuFeature(SysInfo::RDTSCP);
+    if (use_tsc) {
+      // Calibrates over 5 ms, which keeps the error within about 10 ppm.
+      const uint64_t kCalibrationNanos = 5000000;
+      uint64_t start_ns = 0;
+      uint64_t end_ns = 0;
+      uint64_t start_tsc = ReadTscAndNanos(&start_ns);
+      while (MonotonicNanos() - start_ns < kCalibrationNanos) {
+      }
+      uint64_t end_tsc = ReadTscAndNanos(&end_ns);
+      cycles_per_ns = static_cast<double>(end_tsc - start_tsc) /
+          (end_ns - start_ns);
+    }
+#endif
+  }
+
+  uint64_t begin() const {
+#if defined(__x86_64__)
+    if (use_tsc) {
+      return ReadTscBegin();
+    }
+#endif
+    return MonotonicNanos();
+  }
+
+  uint64_t end() const {
+#if defined(__x86_64__)
+    if (use_tsc) {
+      return ReadTscEnd(has_rdtscp);
+    }
+#endif
+    return MonotonicNanos();
+  }
+};
+
+const CycleSource& cycle_source() {
+  static const CycleSource source;
+  return source;
+}
+
+}  // anonymous namespace
+
+CycleTimer::CycleTimer() {
+  // Calibrates now rather than inside the first measurement.
+  cycle_source();
+}
+
+CycleTimer::~CycleTimer() {
+}
+
+void CycleTimer::start() {
+  start_cycles_ = cycle_source().begin();
+}
+
+void CycleTimer::stop() {
+  end_cycles_ = cycle_source().end();
+}
+
+double CycleTimer::get_in_ms() const {
+  return cycles() / cycle_source().cycles_per_ns / kNanosPerMicroSecond;
+}
+
+int64_t CycleTimer::get_in_ns() const {
+  return static_cast<int64_t>(cycles() / cycle_source().cycles_per_ns);
+}
+
+// static
+bool CycleTimer::UsesTsc() {
+  return cycle_source().use_tsc;
+}
+
+// static
+double CycleTimer::cycles_per_ns() {
+  return cycle_source().cycles_per_ns;
 }
 
+//------ CumulatedTimer -------
 CumulatedTimer::~CumulatedTimer() {
 }
 
@@ -72,30 +228,165 @@ void CumulatedTimer::start() {
 
 void CumulatedTimer::stop() {
   Timer::stop();
-  cumulated_milli_seconds_ += Timer::get_in_ms();
+  cumulated_ns_ += Timer::get_in_ns();
 }
 
 double CumulatedTimer::get_in_ms() const {
-  return cumulated_milli_seconds_;
+  return get_in_ns() / kNanosPerMicroSecond;
+}
+
+int64_t CumulatedTimer::get_in_ns() const {
+  return cumulated_ns_;
 }
 
 void CumulatedTimer::reset() {
-  cumulated_milli_seconds_ = 0;
+  cumulated_ns_ = 0;
+}
+
+//------ ConcurrentCumulatedTimer -------
+namespace {
+
+using shard_internal::kNoMin;
+
+std::atomic<uint64_t> next_timer_id(1);
+
+/// The intervals the calling thread has started, by timer id. A thread
+/// rarely has more than one open at a time.
+thread_local std::vector<std::pair<uint64_t, int64_t>> open_intervals;
+
+/// Removes the open interval of timer 'id' and sets 'start_ns' to its
+/// start. Returns false if the calling thread has none.
+bool TakeOpenInterval(uint64_t id, int64_t* start_ns) {
+  for (size_t i = 0; i < open_intervals.size(); i++) {
+    if (open_intervals[i].first == id) {
+      *start_ns = open_intervals[i].second;
+      open_intervals[i] = open_intervals.back();
+      open_intervals.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // anonymous namespace
+
+ConcurrentCumulatedTimer::ConcurrentCumulatedTimer()
+    : ConcurrentCumulatedTimer(Clock::monotonic_clock()) {
 }
 
-UserAndSysUsageTimer::UserAndSysUsageTimer() : begin_(new struct rusage),
-    end_(new struct rusage) {
+ConcurrentCumulatedTimer::ConcurrentCumulatedTimer(Clock* clock)
+    : id_(next_timer_id.fetch_add(1, std::memory_order_relaxed)),
+      clock_(clock) {
+  reset();
+}
+
+ConcurrentCumulatedTimer::~ConcurrentCumulatedTimer() {
+  int64_t start_ns;
+  TakeOpenInterval(id_, &start_ns);
+}
+
+ConcurrentCumulatedTimer::Slot* ConcurrentCumulatedTimer::slot() {
+  return &slots_[shard_internal::ThreadShard(kNumSlots)];
+}
+
+void ConcurrentCumulatedTimer::start() {
+  int64_t now = clock_->now_ns();
+  for (auto& interval : open_intervals) {
+    if (interval.first == id_) {
+      interval.second = now;
+      return;
+    }
+  }
+  open_intervals.emplace_back(id_, now);
+}
+
+void ConcurrentCumulatedTimer::stop() {
+  int64_t now = clock_->now_ns();
+  int64_t start_ns;
+  if (TakeOpenInterval(id_, &start_ns)) {
+    Add(now - start_ns);
+  }
+}
+
+void ConcurrentCumulatedTimer::Add(int64_t ns) {
+  Slot* s = slot();
+  s->total_ns.fetch_add(ns, std::memory_order_relaxed);
+  s->count.fetch_add(1, std::memory_order_relaxed);
+  shard_internal::AtomicStoreMin(&s->min_ns, ns);
+  shard_internal::AtomicStoreMax(&s->max_ns, ns);
+}
+
+double ConcurrentCumulatedTimer::get_in_ms() const {
+  return get_in_ns() / kNanosPerMicroSecond;
+}
+
+int64_t ConcurrentCumulatedTimer::get_in_ns() const {
+  int64_t total = 0;
+  for (const auto& s : slots_) {
+    total += s.total_ns.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+int64_t ConcurrentCumulatedTimer::count() const {
+  int64_t total = 0;
+  for (const auto& s : slots_) {
+    total += s.count.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+int64_t ConcurrentCumulatedTimer::min_ns() const {
+  int64_t min = kNoMin;
+  for (const auto& s : slots_) {
+    min = std::min(min, s.min_ns.load(std::memory_order_relaxed));
+  }
+  return min == kNoMin ? 0 : min;
+}
+
+int64_t ConcurrentCumulatedTimer::max_ns() const {
+  int64_t max = 0;
+  for (const auto& s : slots_) {
+    max = std::max(max, s.max_ns.load(std::memory_order_relaxed));
+  }
+  return max;
+}
+
+void ConcurrentCumulatedTimer::reset() {
+  for (auto& s : slots_) {
+    s.total_ns.store(0, std::memory_order_relaxed);
+    s.count.store(0, std::memory_order_relaxed);
+    s.min_ns.store(kNoMin, std::memory_order_relaxed);
+    s.max_ns.store(0, std::memory_order_relaxed);
+  }
+}
+
+ConcurrentCumulatedTimer::Scope::Scope(ConcurrentCumulatedTimer* timer)
+    : timer_(timer), start_ns_(timer->clock_->now_ns()) {
+}
+
+ConcurrentCumulatedTimer::Scope::~Scope() {
+  timer_->Add(timer_->clock_->now_ns() - start_ns_);
+}
+
+//------ UserAndSysUsageTimer -------
+UserAndSysUsageTimer::UserAndSysUsageTimer()
+    : UserAndSysUsageTimer(RUSAGE_SELF) {
+}
+
+UserAndSysUsageTimer::UserAndSysUsageTimer(int who)
+    : who_(who), begin_(), end_() {
 }
 
 UserAndSysUsageTimer::~UserAndSysUsageTimer() {
 }
 
 void UserAndSysUsageTimer::start() {
-  getrusage(RUSAGE_SELF, begin_.get());
+  getrusage(who_, &begin_);
 }
 
 void UserAndSysUsageTimer::stop() {
-  getrusage(RUSAGE_SELF, end_.get());
+  getrusage(who_, &end_);
 }
 
 double UserAndSysUsageTimer::get_in_ms() const {
@@ -103,7 +394,7 @@ double UserAndSysUsageTimer::get_in_ms() const {
 }
 
 double UserAndSysUsageTimer::user_time_in_ms() const {
-  return get_delta_time(begin_->ru_utime, end_->ru_utime);
+  return get_delta_time(begin_.ru_utime, end_.ru_utime);
 }
 
 double UserAndSysUsageTimer::user_time_in_second() const {
@@ -111,11 +402,56 @@ double UserAndSysUsageTimer::user_time_in_second() const {
 }
 
 double UserAndSysUsageTimer::sys_time_in_ms() const {
-  return get_delta_time(begin_->ru_stime, end_->ru_stime);
+  return get_delta_time(begin_.ru_stime, end_.ru_stime);
 }
 
 double UserAndSysUsageTimer::sys_time_in_second() const {
   return sys_time_in_ms() / kMicroSecond;
 }
 
+//------ ResourceUsageTimer -------
+namespace {
+
+int RusageWho(ResourceUsageTimer::Target target) {
+#if defined(RUSAGE_THREAD)
+  if (target == ResourceUsageTimer::THREAD) {
+    return RUSAGE_THREAD;
+  }
+#endif
+  return RUSAGE_SELF;
+}
+
+}  // anonymous namespace
+
+ResourceUsageTimer::ResourceUsageTimer(Target target)
+    : UserAndSysUsageTimer(RusageWho(target)) {
+}
+
+ResourceUsageTimer::~ResourceUsageTimer() {
+}
+
+int64_t ResourceUsageTimer::voluntary_context_switches() const {
+  return end_.ru_nvcsw - begin_.ru_nvcsw;
+}
+
+int64_t ResourceUsageTimer::involuntary_context_switches() const {
+  return end_.ru_nivcsw - begin_.ru_nivcsw;
+}
+
+int64_t ResourceUsageTimer::major_faults() const {
+  return end_.ru_majflt - begin_.ru_majflt;
+}
+
+int64_t ResourceUsageTimer::minor_faults() const {
+  return end_.ru_minflt - begin_.ru_minflt;
+}
+
+int64_t ResourceUsageTimer::block_input_ops() const {
+  return end_.ru_inblock - begin_.ru_inblock;
+}
+
+int64_t ResourceUsageTimer::block_output_ops() const {
+  return end_.ru_oublock - begin_.ru_oublock;
+}
+
 }  // namespace vobla
@@ -18,10 +18,11 @@
 #define VOBLA_TIMER_H_
 
 #include <boost/utility.hpp>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <atomic>
 #include <memory>
 
-struct rusage;
-
 namespace vobla {
 
 class Clock;
@@ -53,11 +54,12 @@ class TimerInterface : boost::noncopyable {
  * \class Timer
  * \brief A wall time timer.
  *
- * It internally calls gettimeofday().
+ * It keeps nanosecond timestamps from Clock::now_ns(), so intervals shorter
+ * than a microsecond are not rounded away.
  */
 class Timer : public TimerInterface {
  public:
-  /// Constructs a Timer from the Clock::real_clock().
+  /// Constructs a Timer from the Clock::monotonic_clock().
   Timer();
 
   /**
@@ -82,12 +84,15 @@ class Timer : public TimerInterface {
    */
   virtual double get_in_ms() const;
 
+  /// Gets the time consumed in nanoseconds.
+  virtual int64_t get_in_ns() const;
+
  protected:
-  /// Start time.
-  double start_ = 0;
+  /// Start time in nanoseconds.
+  int64_t start_ns_ = 0;
 
-  /// End time.
-  double end_ = 0;
+  /// End time in nanoseconds.
+  int64_t end_ns_ = 0;
 
   /// The Clock object to get timestamp.
   Clock* clock_ = nullptr;
@@ -95,7 +100,13 @@ class Timer : public TimerInterface {
 
 /**
  * \class CycleTimer
- * \brief It uses realtime clock (rtsc) to get time.
+ * \brief It uses the time stamp counter (rdtsc) to get time.
+ *
+ * Reading the TSC takes a few nanoseconds and no system call. The TSC is
+ * only used if it is invariant, i.e., ticks at a constant rate; its rate is
+ * calibrated once per process against CLOCK_MONOTONIC, which takes a few
+ * milliseconds on first use. Otherwise CycleTimer counts the nanoseconds of
+ * CLOCK_MONOTONIC instead of cycles.
  */
 class CycleTimer : public TimerInterface {
  public:
@@ -103,14 +114,40 @@ class CycleTimer : public TimerInterface {
 
   virtual ~CycleTimer();
 
-  /// Starts counting the clocks.
+  /**
+   * \brief Starts counting the clocks.
+   *
+   * Instructions before start() retire before the counter is read.
+   */
   void start();
 
-  /// Stops counting the clocks.
+  /**
+   * \brief Stops counting the clocks.
+   *
+   * The counter is read after the instructions before stop() retire, and
+   * before the ones after it start.
+   */
   void stop();
 
   /// Gets the time consumed in microseconds.
   virtual double get_in_ms() const;
+
+  /// Gets the time consumed in nanoseconds.
+  int64_t get_in_ns() const;
+
+  /// Gets the counter ticks between start() and stop().
+  uint64_t cycles() const { return end_cycles_ - start_cycles_; }
+
+  /// Returns true if the counter is the TSC, not CLOCK_MONOTONIC.
+  static bool UsesTsc();
+
+  /// Returns the counter ticks per nanosecond.
+  static double cycles_per_ns();
+
+ private:
+  uint64_t start_cycles_ = 0;
+
+  uint64_t end_cycles_ = 0;
 };
 
 /**
@@ -141,11 +178,105 @@ class CumulatedTimer : public Timer {
   /// Returns the cumulated microseconds of this timer.
   virtual double get_in_ms() const;
 
+  /// Returns the cumulated nanoseconds of this timer.
+  virtual int64_t get_in_ns() const;
+
   /// Resets the internal timer.
   virtual void reset();
 
  private:
-  double cumulated_milli_seconds_ = 0;
+  int64_t cumulated_ns_ = 0;
+};
+
+/**
+ * \class ConcurrentCumulatedTimer
+ * \brief A CumulatedTimer that many threads can share.
+ *
+ * Each thread times its own intervals with start() and stop(), or with a
+ * Scope, and adds them to one of a fixed set of cache-line-padded slots
+ * with relaxed atomic operations, so threads neither lock nor bounce cache
+ * lines. Readers add the slots up, and may see intervals that end
+ * concurrently only partially counted.
+ */
+class ConcurrentCumulatedTimer : public TimerInterface {
+ public:
+  /// Times intervals with Clock::monotonic_clock().
+  ConcurrentCumulatedTimer();
+
+  /// Times intervals with 'clock', which must outlive the timer.
+  explicit ConcurrentCumulatedTimer(Clock* clock);
+
+  virtual ~ConcurrentCumulatedTimer();
+
+  /**
+   * \brief Starts an interval on the calling thread.
+   *
+   * Threads may time intervals concurrently, each pairing its own start()
+   * and stop(). Destroying the timer drops the open interval of the calling
+   * thread; an interval left open by another thread stays recorded on that
+   * thread until it exits, so prefer a Scope where a timer may die first.
+   */
+  virtual void start();
+
+  /// Ends the calling thread's interval and adds it to the totals.
+  virtual void stop();
+
+  /// Adds an interval measured elsewhere, in nanoseconds.
+  void Add(int64_t ns);
+
+  /// Returns the cumulated microseconds of all intervals.
+  virtual double get_in_ms() const;
+
+  /// Returns the cumulated nanoseconds of all intervals.
+  int64_t get_in_ns() const;
+
+  /// Returns the number of intervals.
+  int64_t count() const;
+
+  /// Returns the shortest interval in nanoseconds, or 0 if there is none.
+  int64_t min_ns() const;
+
+  /// Returns the longest interval in nanoseconds, or 0 if there is none.
+  int64_t max_ns() const;
+
+  /// Forgets all intervals. Intervals added concurrently may be kept.
+  void reset();
+
+  /// Times the lifetime of a scope.
+  class Scope : boost::noncopyable {
+   public:
+    explicit Scope(ConcurrentCumulatedTimer* timer);
+
+    ~Scope();
+
+   private:
+    ConcurrentCumulatedTimer* timer_;
+
+    int64_t start_ns_;
+  };
+
+ private:
+  struct Slot {
+    std::atomic<int64_t> total_ns;
+    std::atomic<int64_t> count;
+    std::atomic<int64_t> min_ns;
+    std::atomic<int64_t> max_ns;
+    /// Keeps slots on separate cache lines.
+    char padding[64];
+  };
+
+  /// Up to this many threads add without sharing a slot.
+  static const int kNumSlots = 16;
+
+  Slot* slot();
+
+  /// Identifies the open intervals of this timer. Unlike the address, it is
+  /// never reused by a later timer.
+  const uint64_t id_;
+
+  Clock* clock_;
+
+  Slot slots_[kNumSlots];
 };
 
 /**
@@ -179,9 +310,55 @@ class UserAndSysUsageTimer : public TimerInterface {
   /// Gets system time in seconds.
   virtual double sys_time_in_second() const;
 
- private:
-  std::unique_ptr<rusage> begin_;
-  std::unique_ptr<rusage> end_;
+ protected:
+  /// Measures the usage of 'who', e.g. RUSAGE_SELF, for getrusage().
+  explicit UserAndSysUsageTimer(int who);
+
+  int who_;
+
+  rusage begin_;
+
+  rusage end_;
+};
+
+/**
+ * \class ResourceUsageTimer
+ * \brief Gets the CPU time, context switches, page faults and block I/O of
+ * the calling thread or of the whole process during the execution.
+ *
+ * Measuring a thread tells which worker of a thread pool stalls, e.g. on
+ * major faults or involuntary context switches. A THREAD timer must be
+ * started and stopped on the same thread. Outside Linux, THREAD measures
+ * the process.
+ */
+class ResourceUsageTimer : public UserAndSysUsageTimer {
+ public:
+  enum Target {
+    PROCESS,
+    THREAD,
+  };
+
+  explicit ResourceUsageTimer(Target target = THREAD);
+
+  virtual ~ResourceUsageTimer();
+
+  /// Gets the number of context switches to wait, e.g. for I/O or a lock.
+  int64_t voluntary_context_switches() const;
+
+  /// Gets the number of context switches by preemption.
+  int64_t involuntary_context_switches() const;
+
+  /// Gets the number of page faults that needed I/O.
+  int64_t major_faults() const;
+
+  /// Gets the number of page faults served without I/O.
+  int64_t minor_faults() const;
+
+  /// Gets the number of block input operations.
+  int64_t block_input_ops() const;
+
+  /// Gets the number of block output operations.
+  int64_t block_output_ops() const;
 };
 
 }  // namespace vobla
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include "vobla/clock.h"
+#include "vobla/timer.h"
+
+namespace vobla {
+
+namespace {
+
+/// The overhead of timing an empty interval.
+template <typename Timer>
+void BM_StartStop(benchmark::State& state) {
+  Timer timer;
+  for (auto _ : state) {
+    timer.start();
+    timer.stop();
+    benchmark::DoNotOptimize(timer.get_in_ms());
+  }
+}
+
+/// Threads sharing one timer.
+void BM_ConcurrentStartStop(benchmark::State& state) {
+  static ConcurrentCumulatedTimer* timer = new ConcurrentCumulatedTimer;
+  for (auto _ : state) {
+    timer->start();
+    timer->stop();
+  }
+}
+
+void BM_NowNs(benchmark::State& state, Clock* clock) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(clock->now_ns());
+  }
+}
+
+/// Reads through a CoarseClock pointer, which inlines the load.
+void BM_CoarseClockNowNs(benchmark::State& state) {
+  CoarseClock clock;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(clock.now_ns());
+  }
+}
+
+}  // anonymous namespace
+
+BENCHMARK_TEMPLATE(BM_StartStop, Timer);
+BENCHMARK_TEMPLATE(BM_StartStop, CycleTimer);
+BENCHMARK_TEMPLATE(BM_StartStop, UserAndSysUsageTimer);
+BENCHMARK_TEMPLATE(BM_StartStop, ResourceUsageTimer);
+BENCHMARK_TEMPLATE(BM_StartStop, CumulatedTimer);
+BENCHMARK_TEMPLATE(BM_StartStop, ConcurrentCumulatedTimer);
+BENCHMARK(BM_ConcurrentStartStop)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_CAPTURE(BM_NowNs, real, Clock::real_clock());
+BENCHMARK_CAPTURE(BM_NowNs, monotonic, Clock::monotonic_clock());
+BENCHMARK_CAPTURE(BM_NowNs, coarse, Clock::coarse_clock());
+BENCHMARK(BM_CoarseClockNowNs);
+
+}  // namespace vobla
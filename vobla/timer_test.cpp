@@ -16,6 +16,11 @@
 
 #include <gtest/gtest.h>
 #include <unistd.h>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "vobla/clock.h"
 #include "vobla/timer.h"
 
 namespace vobla {
@@ -39,4 +44,156 @@ TEST(TimerTest, TestCumulatedTimer) {
   }
 }
 
+TEST(TimerTest, SubMicrosecondIntervals) {
+  FakeClock clock(100);
+  Timer timer(&clock);
+  timer.start();
+  clock.advance(250e-9);
+  timer.stop();
+  EXPECT_EQ(250, timer.get_in_ns());
+  EXPECT_DOUBLE_EQ(0.25, timer.get_in_ms());
+
+  CumulatedTimer cumulated;
+  for (int i = 0; i < 4; i++) {
+    cumulated.start();
+    cumulated.stop();
+  }
+  EXPECT_LE(0, cumulated.get_in_ns());
+  EXPECT_LT(cumulated.get_in_ns(), 1000000);
+}
+
+TEST(TimerTest, CycleTimer) {
+  EXPECT_LT(0, CycleTimer::cycles_per_ns());
+  CycleTimer timer;
+  timer.start();
+  usleep(2000);
+  timer.stop();
+  EXPECT_LE(2000000, timer.get_in_ns());
+  EXPECT_GT(200000000, timer.get_in_ns());
+  EXPECT_NEAR(timer.get_in_ns() / 1000.0, timer.get_in_ms(), 1);
+  EXPECT_NEAR(timer.get_in_second(), timer.get_in_ms() / 1000000, 0.000001);
+}
+
+TEST(TimerTest, ConcurrentCumulatedTimer) {
+  FakeClock clock;
+  ConcurrentCumulatedTimer timer(&clock);
+  EXPECT_EQ(0, timer.count());
+  EXPECT_EQ(0, timer.min_ns());
+  timer.start();
+  clock.advance(0.000003);
+  timer.stop();
+  {
+    ConcurrentCumulatedTimer::Scope scope(&timer);
+    clock.advance(0.000001);
+  }
+  EXPECT_EQ(2, timer.count());
+  EXPECT_EQ(4000, timer.get_in_ns());
+  EXPECT_EQ(1000, timer.min_ns());
+  EXPECT_EQ(3000, timer.max_ns());
+  timer.reset();
+  EXPECT_EQ(0, timer.get_in_ns());
+
+  const int kThreads = 8;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&timer, t] {
+      for (int i = 1; i <= 1000; i++) {
+        timer.Add(t * 1000 + i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(kThreads * 1000, timer.count());
+  EXPECT_EQ(1, timer.min_ns());
+  EXPECT_EQ(kThreads * 1000, timer.max_ns());
+  int64_t n = kThreads * 1000;
+  EXPECT_EQ(n * (n + 1) / 2, timer.get_in_ns());
+}
+
+TEST(TimerTest, ResourceUsageTimer) {
+  ResourceUsageTimer timer;
+  timer.start();
+  // Touches fresh pages, sleeps, and burns some CPU on this thread only.
+  std::vector<char> pages(16 << 20, 1);
+  usleep(1000);
+  volatile uint64_t sum = 0;
+  for (size_t i = 0; i < pages.size(); i++) {
+    sum += pages[i];
+  }
+  timer.stop();
+  EXPECT_LE(1, timer.voluntary_context_switches());
+  EXPECT_LE(0, timer.involuntary_context_switches());
+  EXPECT_LE(1, timer.minor_faults());
+  EXPECT_LE(0, timer.major_faults());
+  EXPECT_LE(0, timer.block_input_ops());
+  EXPECT_LE(0, timer.block_output_ops());
+  EXPECT_LT(0, timer.get_in_ms());
+
+  // Another thread's work is not counted.
+  ResourceUsageTimer idle;
+  idle.start();
+  std::thread busy([] {
+    std::vector<char> other(16 << 20, 1);
+    EXPECT_EQ(1, other[12345]);
+  });
+  busy.join();
+  idle.stop();
+  EXPECT_GT(timer.minor_faults(), idle.minor_faults());
+}
+
+TEST(TimerTest, ConcurrentCumulatedTimerDestroyedWhileOpen) {
+  FakeClock clock;
+  // Reuses the same storage, thus the same address, for a second timer.
+  std::aligned_storage<sizeof(ConcurrentCumulatedTimer),
+      alignof(ConcurrentCumulatedTimer)>::type storage;
+  ConcurrentCumulatedTimer* first = new (&storage)
+      ConcurrentCumulatedTimer(&clock);
+  first->start();
+  first->~ConcurrentCumulatedTimer();
+  clock.advance(1);
+  ConcurrentCumulatedTimer* second = new (&storage)
+      ConcurrentCumulatedTimer(&clock);
+  ASSERT_EQ(first, second);
+  // The interval the first timer left open is not charged to the second.
+  second->stop();
+  EXPECT_EQ(0, second->count());
+  second->~ConcurrentCumulatedTimer();
+}
+
+TEST(ClockTest, MonotonicClock) {
+  Clock* clock = Clock::monotonic_clock();
+  int64_t prev = clock->now_ns();
+  for (int i = 0; i < 1000; i++) {
+    int64_t now = clock->now_ns();
+    EXPECT_LE(prev, now);
+    prev = now;
+  }
+  EXPECT_NEAR(clock->now(), clock->now_ns() / 1e9, 0.001);
+  EXPECT_NEAR(Clock::real_clock()->now(),
+              Clock::real_clock()->now_ns() / 1e9, 0.001);
+}
+
+TEST(ClockTest, CoarseClock) {
+  Clock* monotonic = Clock::monotonic_clock();
+  CoarseClock clock(monotonic, 0.001);
+  EXPECT_LE(clock.now_ns(), monotonic->now_ns());
+  int64_t prev = clock.now_ns();
+  usleep(20000);
+  int64_t now = clock.now_ns();
+  EXPECT_LT(prev, now);
+  // Behind the source by about the resolution, with slack for scheduling.
+  EXPECT_LE(now, monotonic->now_ns());
+  EXPECT_NEAR(monotonic->now(), clock.now(), 0.05);
+
+  // Ticks rarely enough to read the same time after a while.
+  CoarseClock slow(monotonic, 10);
+  prev = slow.now_ns();
+  usleep(20000);
+  EXPECT_EQ(prev, slow.now_ns());
+
+  EXPECT_NEAR(Clock::real_clock()->now(), Clock::coarse_clock()->now(), 0.05);
+}
+
 }  // namespace vobla
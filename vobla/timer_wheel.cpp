@@ -0,0 +1,203 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include "vobla/timer_wheel.h"
+
+namespace vobla {
+
+namespace {
+
+/// Deadlines beyond this many ticks are inserted at this distance.
+const uint64_t kMaxDistance = (uint64_t(1) << 32) - 1;
+
+}  // anonymous namespace
+
+const TimerWheel::TimerId TimerWheel::kInvalidTimerId;
+
+TimerWheel::TimerWheel(Clock* clock, double tick)
+    : clock_(clock), tick_(tick), nodes_(1 + kLevels * kSlots) {
+  CHECK_GT(tick, 0);
+  current_tick_ = NowTick();
+  for (uint32_t i = 0; i < nodes_.size(); i++) {
+    nodes_[i].prev = i;
+    nodes_[i].next = i;
+  }
+}
+
+TimerWheel::~TimerWheel() {
+}
+
+void TimerWheel::reserve(size_t num_timers) {
+  nodes_.reserve(1 + kLevels * kSlots + num_timers);
+}
+
+uint64_t TimerWheel::NowTick() const {
+  double now = clock_->now() / tick_;
+  return now > 0 ? static_cast<uint64_t>(now) : 0;
+}
+
+void TimerWheel::PushBack(uint32_t head, uint32_t index) {
+  Node& node = nodes_[index];
+  node.prev = nodes_[head].prev;
+  node.next = head;
+  nodes_[node.prev].next = index;
+  nodes_[head].prev = index;
+}
+
+void TimerWheel::Unlink(uint32_t index) {
+  Node& node = nodes_[index];
+  nodes_[node.prev].next = node.next;
+  nodes_[node.next].prev = node.prev;
+  node.prev = node.next = index;
+  level_size_[node.level]--;
+}
+
+void TimerWheel::Splice(uint32_t from, uint32_t to) {
+  if (nodes_[from].next == from) {
+    return;
+  }
+  nodes_[to].next = nodes_[from].next;
+  nodes_[to].prev = nodes_[from].prev;
+  nodes_[nodes_[to].next].prev = to;
+  nodes_[nodes_[to].prev].next = to;
+  nodes_[from].next = nodes_[from].prev = from;
+}
+
+void TimerWheel::Insert(uint32_t index) {
+  DCHECK_GE(nodes_[index].deadline, current_tick_);
+  uint64_t distance = std::min(nodes_[index].deadline - current_tick_,
+                               kMaxDistance);
+  uint64_t deadline = current_tick_ + distance;
+  int level = 0;
+  while (level < kLevels - 1 &&
+         distance >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+    level++;
+  }
+  int slot = (deadline >> (kSlotBits * level)) & (kSlots - 1);
+  nodes_[index].level = static_cast<uint8_t>(level);
+  level_size_[level]++;
+  PushBack(SlotHead(level, slot), index);
+}
+
+void TimerWheel::Cascade(int level, int slot) {
+  const uint32_t head = SlotHead(level, slot);
+  while (nodes_[head].next != head) {
+    uint32_t index = nodes_[head].next;
+    Unlink(index);
+    Insert(index);
+  }
+}
+
+uint32_t TimerWheel::Allocate() {
+  if (free_list_) {
+    uint32_t index = free_list_;
+    free_list_ = nodes_[index].next;
+    return index;
+  }
+  CHECK_LT(nodes_.size(), kMaxDistance) << "Too many timers";
+  nodes_.emplace_back();
+  nodes_.back().generation = 0;
+  return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void TimerWheel::Free(uint32_t index) {
+  Node& node = nodes_[index];
+  node.callback = nullptr;
+  node.generation++;
+  node.next = free_list_;
+  free_list_ = index;
+  size_--;
+}
+
+TimerWheel::TimerId TimerWheel::Schedule(double delay, Callback callback) {
+  // Round the deadline up so that the timer never fires early.
+  double deadline = std::ceil((clock_->now() + std::max(delay, 0.0)) / tick_);
+  uint32_t index = Allocate();
+  Node& node = nodes_[index];
+  node.callback = std::move(callback);
+  // Ticks up to current_tick_ have expired, so due timers fire on the next.
+  node.deadline = std::max(static_cast<uint64_t>(std::max(deadline, 0.0)),
+                           current_tick_ + 1);
+  Insert(index);
+  size_++;
+  return (static_cast<uint64_t>(node.generation) << 32) | index;
+}
+
+bool TimerWheel::Cancel(TimerId id) {
+  uint32_t index = static_cast<uint32_t>(id);
+  uint32_t generation = static_cast<uint32_t>(id >> 32);
+  if (index <= SlotHead(kLevels - 1, kSlots - 1) || index >= nodes_.size()) {
+    return false;
+  }
+  Node& node = nodes_[index];
+  // A pending node is linked to a list, thus not to itself.
+  if (node.generation != generation || node.next == index) {
+    return false;
+  }
+  Unlink(index);
+  Free(index);
+  return true;
+}
+
+size_t TimerWheel::Expire() {
+  const uint64_t now = NowTick();
+  size_t fired = 0;
+  while (current_tick_ < now) {
+    // Nothing happens until the lowest non-empty level cascades.
+    int lowest = 0;
+    while (lowest < kLevels && level_size_[lowest] == 0) {
+      lowest++;
+    }
+    if (lowest == kLevels) {
+      current_tick_ = now;
+      break;
+    }
+    if (lowest > 0) {
+      const uint64_t span = uint64_t(1) << (kSlotBits * lowest);
+      current_tick_ = std::min(now - 1, (current_tick_ | (span - 1)));
+    }
+    current_tick_++;
+    // Cascade a level whenever the levels below it wrap around.
+    for (int level = 1; level < kLevels; level++) {
+      if (current_tick_ & ((uint64_t(1) << (kSlotBits * level)) - 1)) {
+        break;
+      }
+      Cascade(level, (current_tick_ >> (kSlotBits * level)) & (kSlots - 1));
+    }
+    Splice(SlotHead(0, current_tick_ & (kSlots - 1)), kExpiring);
+    // Callbacks may cancel the timers still in the batch.
+    while (nodes_[kExpiring].next != kExpiring) {
+      uint32_t index = nodes_[kExpiring].next;
+      Unlink(index);
+      if (nodes_[index].deadline > current_tick_) {
+        // Beyond the longest distance; not due yet.
+        Insert(index);
+        continue;
+      }
+      Callback callback = std::move(nodes_[index].callback);
+      Free(index);
+      callback();
+      fired++;
+    }
+  }
+  return fired;
+}
+
+}  // namespace vobla
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file timer_wheel.h
+ * \brief A hierarchical timing wheel for millions of timeouts.
+ *
+ * \code{.cpp}
+ * TimerWheel wheel;
+ * TimerWheel::TimerId id = wheel.Schedule(30, [conn] { conn->Close(); });
+ * ...
+ * wheel.Cancel(id);  // The connection became active again.
+ * ...
+ * wheel.Expire();  // Called from the event loop, e.g. every millisecond.
+ * \endcode
+ */
+
+#ifndef VOBLA_TIMER_WHEEL_H_
+#define VOBLA_TIMER_WHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <boost/utility.hpp>
+#include <functional>
+#include <vector>
+#include "vobla/clock.h"
+
+namespace vobla {
+
+/**
+ * \class TimerWheel
+ * \brief Runs callbacks once their timeouts expire on a Clock.
+ *
+ * Time is split into ticks. Timers are kept in four levels of 256 slots,
+ * each level spanning 256 times the previous one, so that Schedule() and
+ * Cancel() are O(1) and Expire() only touches the timers that expire, plus
+ * those cascading to a lower level, which each timer does at most three
+ * times. Timers further than 2^32 ticks away are re-cascaded until due.
+ *
+ * A timer never fires early: it fires on the first Expire() at or after its
+ * deadline, rounded up to a tick. Expire() reads the clock, so a FakeClock
+ * drives the wheel deterministically.
+ *
+ * It is not thread-safe; use it from one thread, e.g. an event loop.
+ * Callbacks may schedule and cancel timers, including ones in the same batch.
+ */
+class TimerWheel : boost::noncopyable {
+ public:
+  typedef std::function<void()> Callback;
+
+  /// Identifies a scheduled timer. Ids of fired or canceled timers are not
+  /// reused for a long time (2^32 reuses of a slot).
+  typedef uint64_t TimerId;
+
+  /// No timer has this id.
+  static const TimerId kInvalidTimerId = 0;
+
+  /**
+   * \brief Constructs a wheel with no timer.
+   *
+   * \param clock the clock to read deadlines from; it must outlive the wheel.
+   * \param tick the resolution in seconds.
+   */
+  explicit TimerWheel(Clock* clock = Clock::monotonic_clock(),
+                      double tick = 0.001);
+
+  ~TimerWheel();
+
+  /// Runs 'callback' once 'delay' seconds from now have passed.
+  TimerId Schedule(double delay, Callback callback);
+
+  /// Cancels a pending timer. Returns false if it fired or was canceled.
+  bool Cancel(TimerId id);
+
+  /**
+   * \brief Runs the callbacks of all timers expired by the clock's now.
+   *
+   * \return the number of callbacks run.
+   */
+  size_t Expire();
+
+  /// Returns the number of pending timers.
+  size_t size() const { return size_; }
+
+  /// Preallocates room for 'num_timers' pending timers.
+  void reserve(size_t num_timers);
+
+ private:
+  struct Node {
+    Callback callback;
+
+    /// The tick at which the timer fires.
+    uint64_t deadline;
+
+    /// The neighbors in a circular list, whose head is a sentinel node.
+    uint32_t prev;
+    uint32_t next;
+
+    /// Bumped each time the node is freed, to detect stale ids.
+    uint32_t generation;
+
+    /// The level of the slot holding the timer.
+    uint8_t level;
+  };
+
+  static const int kLevels = 4;
+  static const int kSlotBits = 8;
+  static const int kSlots = 1 << kSlotBits;
+
+  /// The sentinel of the batch being expired; slot sentinels follow it.
+  static const uint32_t kExpiring = 0;
+
+  /// Returns the sentinel of the slot list.
+  static uint32_t SlotHead(int level, int slot) {
+    return 1 + level * kSlots + slot;
+  }
+
+  uint64_t NowTick() const;
+
+  /// Links a timer into the slot list its deadline falls in.
+  void Insert(uint32_t index);
+
+  void PushBack(uint32_t head, uint32_t index);
+
+  /// Unlinks a timer from its list.
+  void Unlink(uint32_t index);
+
+  /// Moves all nodes of list 'from' to the empty list 'to'.
+  void Splice(uint32_t from, uint32_t to);
+
+  /// Re-inserts the timers of a slot in a higher level.
+  void Cascade(int level, int slot);
+
+  uint32_t Allocate();
+
+  void Free(uint32_t index);
+
+  Clock* clock_;
+
+  const double tick_;
+
+  /// All ticks up to this one have expired.
+  uint64_t current_tick_;
+
+  /// Sentinels first, then timers, linked in lists by index.
+  std::vector<Node> nodes_;
+
+  /// The head of the free nodes, linked by 'next'; 0 if none.
+  uint32_t free_list_ = 0;
+
+  size_t size_ = 0;
+
+  /// The number of timers in each level, to skip ticks when the lower
+  /// levels are empty.
+  size_t level_size_[kLevels] = {};
+};
+
+}  // namespace vobla
+
+#endif  // VOBLA_TIMER_WHEEL_H_
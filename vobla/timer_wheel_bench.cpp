@@ -0,0 +1,98 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <random>
+#include "vobla/clock.h"
+#include "vobla/timer_wheel.h"
+
+namespace vobla {
+
+namespace {
+
+const int kOutstanding = 10000000;
+
+/// Timeouts spread over an hour, at the default 1ms tick.
+const double kMaxDelay = 3600;
+
+FakeClock* wheel_clock = new FakeClock;
+
+std::mt19937 rng(42);
+
+double RandomDelay() {
+  return std::uniform_real_distribution<double>(0, kMaxDelay)(rng);
+}
+
+/// A wheel holding kOutstanding timers, each rescheduled once fired.
+TimerWheel* LoadedWheel() {
+  static TimerWheel* wheel = [] {
+    TimerWheel* wheel = new TimerWheel(wheel_clock);
+    wheel->reserve(kOutstanding + 1000);
+    for (int i = 0; i < kOutstanding; i++) {
+      wheel->Schedule(RandomDelay(), [] {});
+    }
+    return wheel;
+  }();
+  return wheel;
+}
+
+/// Fills a wheel with state.range(0) timers.
+void BM_Populate(benchmark::State& state) {
+  for (auto _ : state) {
+    TimerWheel wheel(wheel_clock);
+    wheel.reserve(state.range(0));
+    for (int64_t i = 0; i < state.range(0); i++) {
+      wheel.Schedule(RandomDelay(), [] {});
+    }
+    benchmark::DoNotOptimize(wheel.size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+/// Schedules and cancels a timer among kOutstanding ones.
+void BM_ScheduleCancel(benchmark::State& state) {
+  TimerWheel* wheel = LoadedWheel();
+  for (auto _ : state) {
+    wheel->Cancel(wheel->Schedule(RandomDelay(), [] {}));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+/// Expires one tick of kOutstanding timers, rescheduling the fired ones,
+/// about 3 per tick.
+void BM_ExpireTick(benchmark::State& state) {
+  TimerWheel* wheel = LoadedWheel();
+  int64_t fired = 0;
+  for (auto _ : state) {
+    wheel_clock->advance(0.001);
+    size_t n = wheel->Expire();
+    fired += n;
+    state.PauseTiming();
+    for (size_t i = 0; i < n; i++) {
+      wheel->Schedule(RandomDelay(), [] {});
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(fired);
+}
+
+}  // anonymous namespace
+
+BENCHMARK(BM_Populate)->Arg(kOutstanding)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ScheduleCancel);
+BENCHMARK(BM_ExpireTick)->Unit(benchmark::kMicrosecond);
+
+}  // namespace vobla
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include "vobla/clock.h"
+#include "vobla/timer_wheel.h"
+
+namespace vobla {
+
+TEST(TimerWheelTest, FiresAtDeadline) {
+  FakeClock clock(1000);
+  TimerWheel wheel(&clock, 1);
+  std::vector<int> fired;
+  wheel.Schedule(3, [&] { fired.push_back(3); });
+  wheel.Schedule(1, [&] { fired.push_back(1); });
+  wheel.Schedule(1.5, [&] { fired.push_back(2); });
+  EXPECT_EQ(3u, wheel.size());
+
+  EXPECT_EQ(0u, wheel.Expire());
+  clock.advance(1);
+  EXPECT_EQ(1u, wheel.Expire());
+  EXPECT_EQ(std::vector<int>({1}), fired);
+  // 1.5 seconds is rounded up to 2 ticks, never fired early.
+  clock.advance(0.5);
+  EXPECT_EQ(0u, wheel.Expire());
+  clock.advance(0.5);
+  EXPECT_EQ(1u, wheel.Expire());
+  clock.advance(5);
+  EXPECT_EQ(1u, wheel.Expire());
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), fired);
+  EXPECT_EQ(0u, wheel.size());
+}
+
+TEST(TimerWheelTest, Cancel) {
+  FakeClock clock;
+  TimerWheel wheel(&clock, 1);
+  int fired = 0;
+  TimerWheel::TimerId id = wheel.Schedule(10, [&] { fired++; });
+  TimerWheel::TimerId other = wheel.Schedule(10, [&] { fired++; });
+  EXPECT_TRUE(wheel.Cancel(id));
+  EXPECT_FALSE(wheel.Cancel(id));
+  EXPECT_FALSE(wheel.Cancel(TimerWheel::kInvalidTimerId));
+  EXPECT_EQ(1u, wheel.size());
+
+  clock.advance(10);
+  EXPECT_EQ(1u, wheel.Expire());
+  EXPECT_EQ(1, fired);
+  EXPECT_FALSE(wheel.Cancel(other));
+
+  // The freed node is reused under a new id.
+  TimerWheel::TimerId reused = wheel.Schedule(1, [] {});
+  EXPECT_NE(id, reused);
+  EXPECT_NE(other, reused);
+  EXPECT_FALSE(wheel.Cancel(id));
+  EXPECT_TRUE(wheel.Cancel(reused));
+}
+
+TEST(TimerWheelTest, CallbacksScheduleAndCancel) {
+  FakeClock clock;
+  TimerWheel wheel(&clock, 1);
+  int fired = 0;
+  TimerWheel::TimerId second = 0;
+  wheel.Schedule(5, [&] {
+    fired++;
+    // Cancels a timer of the same batch, and reschedules.
+    EXPECT_TRUE(wheel.Cancel(second));
+    wheel.Schedule(0, [&] { fired += 10; });
+  });
+  second = wheel.Schedule(5, [&] { fired += 100; });
+  clock.advance(5);
+  EXPECT_EQ(1u, wheel.Expire());
+  EXPECT_EQ(1, fired);
+  // A due timer scheduled while expiring fires on the next tick.
+  clock.advance(1);
+  EXPECT_EQ(1u, wheel.Expire());
+  EXPECT_EQ(11, fired);
+}
+
+TEST(TimerWheelTest, FarDeadlines) {
+  FakeClock clock;
+  TimerWheel wheel(&clock, 0.001);
+  // Cascades through every level, and beyond 2^32 ticks (50 days).
+  const double delays[] = {0.2, 60, 3600, 86400 * 30, 86400 * 365};
+  std::vector<double> fired_at;
+  for (double delay : delays) {
+    wheel.Schedule(delay, [&] { fired_at.push_back(clock.now()); });
+  }
+  double step = 0.1;
+  while (wheel.size() && clock.now() < 86400 * 400) {
+    clock.advance(step);
+    step = std::min(step * 1.5, 3600.0);
+    wheel.Expire();
+  }
+  ASSERT_EQ(5u, fired_at.size());
+  for (size_t i = 0; i < fired_at.size(); i++) {
+    EXPECT_LE(delays[i], fired_at[i]);
+    if (i) {
+      EXPECT_LT(fired_at[i - 1], fired_at[i]);
+    }
+  }
+}
+
+TEST(TimerWheelTest, RandomTimers) {
+  FakeClock clock;
+  TimerWheel wheel(&clock, 1);
+  std::mt19937 rng(42);
+  const int kTimers = 20000;
+  std::vector<int64_t> deadlines(kTimers);
+  std::vector<int64_t> fired_at(kTimers, -1);
+  std::vector<TimerWheel::TimerId> ids(kTimers);
+  std::vector<bool> canceled(kTimers);
+  for (int i = 0; i < kTimers; i++) {
+    int64_t delay = rng() % (1 << (rng() % 24));
+    deadlines[i] = delay;
+    ids[i] = wheel.Schedule(delay, [&, i] {
+      EXPECT_EQ(-1, fired_at[i]);
+      fired_at[i] = static_cast<int64_t>(clock.now());
+    });
+  }
+  for (int i = 0; i < kTimers; i += 7) {
+    canceled[i] = true;
+    EXPECT_TRUE(wheel.Cancel(ids[i]));
+  }
+  int64_t last = 0;
+  while (wheel.size()) {
+    clock.advance(1 + rng() % 5000);
+    wheel.Expire();
+    int64_t now = static_cast<int64_t>(clock.now());
+    for (int i = 0; i < kTimers; i++) {
+      if (canceled[i]) {
+        EXPECT_EQ(-1, fired_at[i]);
+      } else if (deadlines[i] <= last) {
+        EXPECT_NE(-1, fired_at[i]);
+      } else if (deadlines[i] > now) {
+        EXPECT_EQ(-1, fired_at[i]);
+      } else {
+        // Due since the previous Expire().
+        EXPECT_EQ(now, fired_at[i]);
+      }
+    }
+    last = now;
+  }
+}
+
+}  // namespace vobla
@@ -0,0 +1,282 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "vobla/clock.h"
+#include "vobla/file_util.h"
+#include "vobla/gutil/stringprintf.h"
+#include "vobla/profiler.h"
+#include "vobla/trace.h"
+
+using std::string;
+
+namespace vobla {
+
+namespace {
+
+struct TraceEvent {
+  const char* name;
+  int64_t start_ns;
+  int64_t duration_ns;
+  int tid;
+};
+
+/// The spans of one thread. Only that thread writes; it keeps the newest
+/// events.size() spans. Once the thread exits, the buffer is handed to the
+/// next thread that starts tracing, which appends to the same ring.
+struct ThreadBuffer {
+  explicit ThreadBuffer(size_t capacity) : events(capacity) {
+    recorded.store(0, std::memory_order_relaxed);
+  }
+
+  /// The thread writing to the buffer.
+  int tid = 0;
+
+  std::vector<TraceEvent> events;
+
+  /// The number of spans ever recorded, published after each write.
+  std::atomic<uint64_t> recorded;
+};
+
+std::atomic<bool> tracing_enabled(false);
+
+std::atomic<size_t> ring_size(Tracer::kDefaultEventsPerThread);
+
+/// All thread buffers. Buffers of exited threads are kept with their spans
+/// and reused, so there are as many as threads ever traced concurrently.
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+  /// The buffers of exited threads.
+  std::vector<ThreadBuffer*> released;
+};
+
+Registry& registry() {
+  static Registry* registry = new Registry;
+  return *registry;
+}
+
+int CurrentThreadId() {
+#if defined(__linux__)
+  return static_cast<int>(syscall(SYS_gettid));
+#else
+  static std::atomic<int> next_id(1);
+  return next_id.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+/// Releases the buffer of a thread when it exits.
+struct ThreadBufferHolder {
+  ~ThreadBufferHolder() {
+    if (buffer) {
+      Registry& r = registry();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      r.released.push_back(buffer);
+    }
+  }
+
+  ThreadBuffer* buffer = nullptr;
+};
+
+ThreadBuffer* AcquireThreadBuffer() {
+  const size_t capacity = ring_size.load(std::memory_order_relaxed);
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  ThreadBuffer* buffer;
+  if (r.released.empty()) {
+    r.buffers.emplace_back(new ThreadBuffer(capacity));
+    buffer = r.buffers.back().get();
+  } else {
+    buffer = r.released.back();
+    r.released.pop_back();
+    if (buffer->events.size() != capacity) {
+      // The ring size changed since the buffer was created.
+      buffer->events.assign(capacity, TraceEvent());
+      buffer->recorded.store(0, std::memory_order_relaxed);
+    }
+  }
+  buffer->tid = CurrentThreadId();
+  return buffer;
+}
+
+ThreadBuffer* CurrentThreadBuffer() {
+  static thread_local ThreadBufferHolder holder;
+  if (!holder.buffer) {
+    holder.buffer = AcquireThreadBuffer();
+  }
+  return holder.buffer;
+}
+
+/// Appends 'str' to 'out' as a JSON string literal.
+void AppendJsonString(const char* str, string* out) {
+  out->push_back('"');
+  for (const char* p = str; *p; p++) {
+    unsigned char c = static_cast<unsigned char>(*p);
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      StringAppendF(out, "\\u%04x", c);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+}  // anonymous namespace
+
+// static
+const size_t Tracer::kDefaultEventsPerThread;
+
+// static
+void Tracer::Enable(size_t events_per_thread) {
+  ring_size.store(std::max<size_t>(events_per_thread, 1),
+                  std::memory_order_relaxed);
+  tracing_enabled.store(true, std::memory_order_relaxed);
+}
+
+// static
+void Tracer::Disable() {
+  tracing_enabled.store(false, std::memory_order_relaxed);
+}
+
+// static
+bool Tracer::enabled() {
+  return tracing_enabled.load(std::memory_order_relaxed);
+}
+
+// static
+void Tracer::Clear() {
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (const auto& buffer : r.buffers) {
+    buffer->recorded.store(0, std::memory_order_release);
+  }
+}
+
+// static
+size_t Tracer::size() {
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  size_t total = 0;
+  for (const auto& buffer : r.buffers) {
+    total += std::min<uint64_t>(
+        buffer->recorded.load(std::memory_order_acquire),
+        buffer->events.size());
+  }
+  return total;
+}
+
+// static
+void Tracer::Record(const char* name, int64_t start_ns, int64_t duration_ns) {
+  ThreadBuffer* buffer = CurrentThreadBuffer();
+  uint64_t n = buffer->recorded.load(std::memory_order_relaxed);
+  TraceEvent& event = buffer->events[n % buffer->events.size()];
+  event.name = name;
+  event.start_ns = start_ns;
+  event.duration_ns = duration_ns;
+  event.tid = buffer->tid;
+  buffer->recorded.store(n + 1, std::memory_order_release);
+}
+
+// static
+string Tracer::ChromeTraceJson() {
+  const int pid = getpid();
+  string json = "{\"traceEvents\":[";
+  bool first = true;
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (const auto& buffer : r.buffers) {
+    const uint64_t recorded = buffer->recorded.load(std::memory_order_acquire);
+    const uint64_t capacity = buffer->events.size();
+    const uint64_t begin = recorded > capacity ? recorded - capacity : 0;
+    for (uint64_t i = begin; i < recorded; i++) {
+      const TraceEvent& event = buffer->events[i % capacity];
+      if (!first) {
+        json.push_back(',');
+      }
+      first = false;
+      json += "\n{\"name\":";
+      AppendJsonString(event.name, &json);
+      // Timestamps are in microseconds.
+      StringAppendF(&json,
+                    ",\"cat\":\"vobla\",\"ph\":\"X\",\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                    event.start_ns / 1000.0, event.duration_ns / 1000.0, pid,
+                    event.tid);
+    }
+  }
+  json += "\n],\"displayTimeUnit\":\"ns\"}\n";
+  return json;
+}
+
+// static
+Status Tracer::WriteChromeTrace(const string& path) {
+  return WriteStringToFile(path, ChromeTraceJson());
+}
+
+// ---- TraceSpan ----
+
+TraceSpan::TraceSpan(const char* name) : name_(name) {
+  start();
+}
+
+TraceSpan::~TraceSpan() {
+  stop();
+}
+
+void TraceSpan::start() {
+  enabled_ = Tracer::enabled();
+  stopped_ = false;
+  if (!tagged_ && Profiler::enabled()) {
+    tagged_ = true;
+    parent_tag_ = Profiler::SetThreadTag(name_);
+  }
+  if (enabled_) {
+    start_ns_ = Clock::monotonic_clock()->now_ns();
+  }
+}
+
+void TraceSpan::stop() {
+  if (stopped_) {
+    return;
+  }
+  stopped_ = true;
+  if (tagged_) {
+    tagged_ = false;
+    Profiler::SetThreadTag(parent_tag_);
+  }
+  if (enabled_) {
+    duration_ns_ = Clock::monotonic_clock()->now_ns() - start_ns_;
+    Tracer::Record(name_, start_ns_, duration_ns_);
+  }
+}
+
+double TraceSpan::get_in_ms() const {
+  return duration_ns_ / 1000.0;
+}
+
+}  // namespace vobla
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * \file trace.h
+ * \brief Scoped tracing spans, exported as a Chrome trace_event timeline.
+ *
+ * \code{.cpp}
+ * Tracer::Enable();
+ * {
+ *   VOBLA_TRACE_SPAN("LoadIndex");
+ *   ...
+ * }
+ * Tracer::WriteChromeTrace("/tmp/job.json");  // Open in chrome://tracing.
+ * \endcode
+ */
+
+#ifndef VOBLA_TRACE_H_
+#define VOBLA_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "vobla/gutil/macros.h"
+#include "vobla/status.h"
+#include "vobla/timer.h"
+
+namespace vobla {
+
+/**
+ * \class Tracer
+ * \brief Collects the spans recorded by all threads.
+ *
+ * Each thread records into its own ring buffer, which is allocated on the
+ * thread's first span and keeps its newest events once full. When a thread
+ * exits, its buffer keeps its spans and passes to the next thread starting
+ * to trace, so memory grows with the number of threads tracing at once, not
+ * with the number of threads ever created. Recording takes no lock. While
+ * tracing is disabled, a span costs one atomic load.
+ */
+class Tracer {
+ public:
+  /// The default number of spans each thread keeps.
+  static const size_t kDefaultEventsPerThread = 1 << 15;
+
+  /**
+   * \brief Starts recording spans.
+   *
+   * \param events_per_thread the ring buffer size of threads that record
+   * their first span from now on. Reused buffers of another size are
+   * emptied.
+   */
+  static void Enable(size_t events_per_thread = kDefaultEventsPerThread);
+
+  /// Stops recording spans. Recorded spans are kept.
+  static void Disable();
+
+  static bool enabled();
+
+  /// Drops all recorded spans. Threads must not record spans meanwhile.
+  static void Clear();
+
+  /// Returns the number of spans currently kept.
+  static size_t size();
+
+  /**
+   * \brief Returns the recorded spans in the Chrome trace_event JSON format,
+   * which chrome://tracing and Perfetto load.
+   *
+   * Threads must not end spans during the call, since it reads the ring
+   * buffers without synchronizing with their writers and could return torn
+   * events. Call it once the traced work is done, or after disabling
+   * tracing and letting the spans in flight end.
+   */
+  static std::string ChromeTraceJson();
+
+  /// Writes ChromeTraceJson() to a file.
+  static Status WriteChromeTrace(const std::string& path);
+
+ private:
+  friend class TraceSpan;
+
+  /// Records a finished span of the calling thread.
+  static void Record(const char* name, int64_t start_ns, int64_t duration_ns);
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(Tracer);
+};
+
+/**
+ * \class TraceSpan
+ * \brief A timer that records its interval as a span on the Tracer.
+ *
+ * The span starts when constructed and ends when stopped or destroyed,
+ * whichever comes first. Use VOBLA_TRACE_SPAN() to span a scope.
+ *
+ * While the Profiler runs, the samples taken within the span are keyed on
+ * its name. Spans of a thread must then end in the reverse order of their
+ * start, as scoped spans do.
+ */
+class TraceSpan : public TimerInterface {
+ public:
+  /**
+   * \brief Starts a span.
+   *
+   * \param name the span name, which must outlive the Tracer, e.g. a string
+   * literal.
+   */
+  explicit TraceSpan(const char* name);
+
+  virtual ~TraceSpan();
+
+  /// Restarts the span.
+  virtual void start();
+
+  /// Ends the span and records it, once.
+  virtual void stop();
+
+  /// Gets the duration of the stopped span in microseconds, or 0 if tracing
+  /// was disabled when it started.
+  virtual double get_in_ms() const;
+
+ private:
+  const char* name_;
+
+  /// Whether the span records; set when it starts.
+  bool enabled_ = false;
+
+  /// Whether the span tags the samples of the Profiler.
+  bool tagged_ = false;
+
+  /// The tag to restore when the span ends.
+  const char* parent_tag_ = nullptr;
+
+  bool stopped_ = false;
+
+  int64_t start_ns_ = 0;
+
+  int64_t duration_ns_ = 0;
+};
+
+#define VOBLA_TRACE_CONCAT_INNER(a, b) a##b
+#define VOBLA_TRACE_CONCAT(a, b) VOBLA_TRACE_CONCAT_INNER(a, b)
+
+/// Records the rest of the enclosing scope as a span named 'name'.
+#define VOBLA_TRACE_SPAN(name) \
+  ::vobla::TraceSpan VOBLA_TRACE_CONCAT(vobla_trace_span_, __LINE__)(name)
+
+}  // namespace vobla
+
+#endif  // VOBLA_TRACE_H_
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include "vobla/trace.h"
+
+namespace vobla {
+
+namespace {
+
+/// The cost of one span, with tracing enabled if state.range(0) is 1.
+void BM_TraceSpan(benchmark::State& state) {
+  if (state.range(0)) {
+    Tracer::Enable();
+  } else {
+    Tracer::Disable();
+  }
+  for (auto _ : state) {
+    VOBLA_TRACE_SPAN("span");
+  }
+  Tracer::Disable();
+  Tracer::Clear();
+}
+
+}  // anonymous namespace
+
+BENCHMARK(BM_TraceSpan)->Arg(0)->Arg(1)->ThreadRange(1, 4);
+
+}  // namespace vobla
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "vobla/trace.h"
+
+using std::string;
+
+namespace vobla {
+
+namespace {
+
+size_t CountOf(const string& haystack, const string& needle) {
+  size_t count = 0;
+  for (size_t pos = haystack.find(needle); pos != string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    count++;
+  }
+  return count;
+}
+
+}  // anonymous namespace
+
+TEST(TraceTest, RecordsSpansOnlyWhenEnabled) {
+  Tracer::Clear();
+  Tracer::Disable();
+  {
+    VOBLA_TRACE_SPAN("disabled");
+  }
+  EXPECT_EQ(0u, Tracer::size());
+
+  Tracer::Enable();
+  {
+    VOBLA_TRACE_SPAN("outer");
+    {
+      VOBLA_TRACE_SPAN("inner \"quoted\"");
+      usleep(100);
+    }
+  }
+  std::thread worker([] {
+    TraceSpan span("worker");
+    span.stop();
+    EXPECT_LE(0, span.get_in_ms());
+  });
+  worker.join();
+  Tracer::Disable();
+  EXPECT_EQ(3u, Tracer::size());
+
+  const string json = Tracer::ChromeTraceJson();
+  EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+  EXPECT_EQ(3u, CountOf(json, "\"ph\":\"X\""));
+  EXPECT_EQ(1u, CountOf(json, "\"name\":\"outer\""));
+  EXPECT_EQ(1u, CountOf(json, "\"name\":\"inner \\\"quoted\\\"\""));
+  EXPECT_EQ(1u, CountOf(json, "\"name\":\"worker\""));
+  EXPECT_EQ(0u, CountOf(json, "disabled"));
+
+  char path[] = "/tmp/vobla_trace_test.XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_TRUE(Tracer::WriteChromeTrace(path).ok());
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  EXPECT_EQ(json, contents.str());
+  unlink(path);
+
+  Tracer::Clear();
+  EXPECT_EQ(0u, Tracer::size());
+}
+
+TEST(TraceTest, RingBufferKeepsNewestSpans) {
+  Tracer::Clear();
+  // Only threads starting to trace from now on get the small buffer.
+  Tracer::Enable(4);
+  std::thread worker([] {
+    static const char* kNames[] = {"s0", "s1", "s2", "s3", "s4", "s5"};
+    for (const char* name : kNames) {
+      TraceSpan span(name);
+    }
+  });
+  worker.join();
+  Tracer::Disable();
+  const string json = Tracer::ChromeTraceJson();
+  EXPECT_EQ(4u, CountOf(json, "\"ph\":\"X\""));
+  EXPECT_EQ(0u, CountOf(json, "\"s1\""));
+  EXPECT_EQ(1u, CountOf(json, "\"s2\""));
+  EXPECT_EQ(1u, CountOf(json, "\"s5\""));
+  Tracer::Clear();
+  Tracer::Enable(Tracer::kDefaultEventsPerThread);
+  Tracer::Disable();
+}
+
+TEST(TraceTest, ReusesBuffersOfExitedThreads) {
+  Tracer::Clear();
+  Tracer::Enable();
+  // Each thread takes over the buffer of the previous one, which keeps its
+  // spans.
+  for (int i = 0; i < 100; i++) {
+    std::thread worker([] {
+      TraceSpan span("task");
+    });
+    worker.join();
+  }
+  Tracer::Disable();
+  EXPECT_EQ(100u, Tracer::size());
+  EXPECT_EQ(100u, CountOf(Tracer::ChromeTraceJson(), "\"name\":\"task\""));
+  Tracer::Clear();
+}
+
+}  // namespace vobla
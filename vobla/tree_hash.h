@@ -0,0 +1,275 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VOBLA_TREE_HASH_H_
+#define VOBLA_TREE_HASH_H_
+
+#include <boost/utility.hpp>
+#include <glog/logging.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "vobla/hash.h"
+#include "vobla/thread_pool.h"
+
+namespace vobla {
+
+/**
+ * \brief The in-progress state of a TreeHashDigest.
+ */
+template <typename Digest>
+struct TreeHashContext {
+  typedef std::array<unsigned char, Digest::LENGTH> LeafDigest;
+
+  size_t leaf_size = 0;
+
+  ThreadPool* pool = nullptr;
+
+  /// Bytes of the current leaf received by Update() so far.
+  std::string pending;
+
+  /// Digests of the dispatched leaves, in input order. A deque keeps the
+  /// addresses stable while workers fill them in.
+  std::deque<LeafDigest> leaves;
+
+  std::mutex mutex;
+
+  std::condition_variable cond;
+
+  /// Number of leaves being hashed on the pool.
+  size_t in_flight = 0;
+};
+
+/**
+ * \class TreeHashDigest
+ * \brief Hashes large inputs in parallel as a two-level hash tree.
+ *
+ * The input is split into leaves of leaf_size() bytes, the last one possibly
+ * shorter. Each leaf is hashed as Digest(0x00 || leaf) on a ThreadPool, and
+ * the root is Digest(0x01 || leaf_digest_0 || ... || leaf_digest_n-1). An
+ * empty input has a single empty leaf.
+ *
+ * The root depends on the leaf size, so producers and verifiers of a tree
+ * hash must agree on it. Do not use a TreeHashDigest from a task running on
+ * its own pool, since it waits for the leaves to finish. The leaves in flight
+ * belong to the digest, so it is neither copied nor moved.
+ *
+ * \code{.cpp}
+ * TreeHashDigest<SHA1Digest> digest;
+ * digest.Init();
+ * while (...) {
+ *   digest.Update(buffer, size);
+ * }
+ * digest.Final();
+ * \endcode
+ */
+template <typename Digest>
+class TreeHashDigest
+    : public BaseHashDigest<TreeHashContext<Digest>, Digest::LENGTH>,
+      boost::noncopyable {
+  typedef BaseHashDigest<TreeHashContext<Digest>, Digest::LENGTH> Base;
+
+ public:
+  using Base::Reset;
+  using Base::Update;
+
+  enum { kDefaultLeafSize = 1 << 20 };
+
+  /**
+   * \brief Constructs an empty tree digest.
+   *
+   * \param leaf_size the number of input bytes hashed by each leaf.
+   * \param pool hashes the leaves. Defaults to ThreadPool::default_pool().
+   */
+  explicit TreeHashDigest(size_t leaf_size = kDefaultLeafSize,
+                          ThreadPool* pool = nullptr);
+
+  /// Waits for the leaves still being hashed.
+  ~TreeHashDigest();
+
+  /// Returns the number of input bytes in each leaf.
+  size_t leaf_size() const { return this->context_.leaf_size; }
+
+  /// Initializes the digest for a new input.
+  void Init();
+
+  /**
+   * \brief Feeds data to this digest.
+   *
+   * The data is copied into leaf-sized buffers, which are hashed on the
+   * pool as soon as they fill up. Blocks when too many leaves are waiting
+   * to be hashed.
+   */
+  void Update(const void* buffer, size_t size);
+
+  /// Waits for all leaves and computes the root digest.
+  void Final();
+
+  /**
+   * \brief Hashes 'buffer' in one call.
+   *
+   * Unlike Init/Update/Final, the leaves are hashed in place without
+   * being copied.
+   */
+  void Reset(const void* buffer, size_t size);
+
+ private:
+  /// Queues the hashing of one leaf. 'owner' keeps 'data' alive, if set.
+  void Dispatch(const char* data, size_t size,
+                std::shared_ptr<std::string> owner);
+
+  /// Blocks until no leaf is being hashed.
+  void Wait();
+
+  static void HashLeaf(const char* data, size_t size, unsigned char* out);
+};
+
+template <typename Digest>
+TreeHashDigest<Digest>::TreeHashDigest(size_t leaf_size, ThreadPool* pool) {
+  CHECK_GT(leaf_size, 0u);
+  this->context_.leaf_size = leaf_size;
+  this->context_.pool = pool ? pool : ThreadPool::default_pool();
+}
+
+template <typename Digest>
+TreeHashDigest<Digest>::~TreeHashDigest() {
+  Wait();
+}
+
+template <typename Digest>
+void TreeHashDigest<Digest>::Init() {
+  Wait();
+  this->context_.pending.clear();
+  this->context_.leaves.clear();
+}
+
+template <typename Digest>
+void TreeHashDigest<Digest>::Update(const void* buffer, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  TreeHashContext<Digest>& ctx = this->context_;
+  const char* data = static_cast<const char*>(buffer);
+  if (!ctx.pending.empty()) {
+    size_t fill = std::min(size, ctx.leaf_size - ctx.pending.size());
+    ctx.pending.append(data, fill);
+    data += fill;
+    size -= fill;
+    if (ctx.pending.size() < ctx.leaf_size) {
+      return;
+    }
+    std::shared_ptr<std::string> leaf(new std::string);
+    leaf->swap(ctx.pending);
+    Dispatch(leaf->data(), leaf->size(), leaf);
+  }
+  while (size >= ctx.leaf_size) {
+    std::shared_ptr<std::string> leaf(new std::string(data, ctx.leaf_size));
+    Dispatch(leaf->data(), leaf->size(), leaf);
+    data += ctx.leaf_size;
+    size -= ctx.leaf_size;
+  }
+  ctx.pending.assign(data, size);
+}
+
+template <typename Digest>
+void TreeHashDigest<Digest>::Final() {
+  TreeHashContext<Digest>& ctx = this->context_;
+  if (!ctx.pending.empty() || ctx.leaves.empty()) {
+    std::shared_ptr<std::string> leaf(new std::string);
+    leaf->swap(ctx.pending);
+    Dispatch(leaf->data(), leaf->size(), leaf);
+  }
+  Wait();
+
+  static const unsigned char kNodePrefix = 1;
+  Digest root;
+  root.Init();
+  root.Update(&kNodePrefix, 1);
+  for (const auto& leaf : ctx.leaves) {
+    root.Update(leaf.data(), leaf.size());
+  }
+  root.Final();
+  memcpy(this->digest_.data(), root.digest(), Digest::LENGTH);
+  ctx.leaves.clear();
+}
+
+template <typename Digest>
+void TreeHashDigest<Digest>::Reset(const void* buffer, size_t size) {
+  Init();
+  const char* data = static_cast<const char*>(buffer);
+  const size_t leaf_size = this->context_.leaf_size;
+  do {
+    size_t length = std::min(size, leaf_size);
+    Dispatch(data, length, nullptr);
+    data += length;
+    size -= length;
+  } while (size > 0);
+  Final();
+}
+
+template <typename Digest>
+void TreeHashDigest<Digest>::Dispatch(const char* data, size_t size,
+                                      std::shared_ptr<std::string> owner) {
+  TreeHashContext<Digest>* ctx = &this->context_;
+  // Bounds the memory held by copied leaves when the caller feeds data
+  // faster than the pool can hash it.
+  const size_t max_in_flight = 2 * ctx->pool->num_threads();
+  unsigned char* out;
+  {
+    std::unique_lock<std::mutex> lock(ctx->mutex);
+    ctx->cond.wait(lock, [&] { return ctx->in_flight < max_in_flight; });
+    ctx->leaves.emplace_back();
+    out = ctx->leaves.back().data();
+    ctx->in_flight++;
+  }
+  ctx->pool->Schedule([ctx, data, size, out, owner] {
+    HashLeaf(data, size, out);
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->in_flight--;
+    // Notify while holding the lock: once it is released, the waiter may
+    // destroy the context.
+    ctx->cond.notify_all();
+  });
+}
+
+template <typename Digest>
+void TreeHashDigest<Digest>::Wait() {
+  TreeHashContext<Digest>& ctx = this->context_;
+  std::unique_lock<std::mutex> lock(ctx.mutex);
+  ctx.cond.wait(lock, [&] { return ctx.in_flight == 0; });
+}
+
+// static
+template <typename Digest>
+void TreeHashDigest<Digest>::HashLeaf(const char* data, size_t size,
+                                      unsigned char* out) {
+  static const unsigned char kLeafPrefix = 0;
+  Digest digest;
+  digest.Init();
+  digest.Update(&kLeafPrefix, 1);
+  digest.Update(data, size);
+  digest.Final();
+  memcpy(out, digest.digest(), Digest::LENGTH);
+}
+
+}  // namespace vobla
+
+#endif  // VOBLA_TREE_HASH_H_
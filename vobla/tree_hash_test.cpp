@@ -0,0 +1,90 @@
+/*
+ * Copyright 2014 (c) Lei Xu <eddyxu@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include "vobla/thread_pool.h"
+#include "vobla/tree_hash.h"
+
+using std::string;
+
+namespace vobla {
+
+namespace {
+
+string MakeInput(size_t size) {
+  string buf(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    buf[i] = static_cast<char>(i * 7 + i / 251);
+  }
+  return buf;
+}
+
+}  // anonymous namespace
+
+TEST(TreeHashDigestTest, RootOfLeafDigests) {
+  const string input = MakeInput(2500);
+  TreeHashDigest<SHA1Digest> tree(1000);
+  tree.Reset(input);
+
+  string node("\x01", 1);
+  for (size_t offset = 0; offset < input.size(); offset += 1000) {
+    SHA1Digest leaf(string("\0", 1) + input.substr(offset, 1000));
+    node.append(reinterpret_cast<const char*>(leaf.digest()),
+                SHA1Digest::LENGTH);
+  }
+  EXPECT_EQ(SHA1Digest(node).hexdigest(), tree.hexdigest());
+
+  TreeHashDigest<SHA1Digest> empty(1000);
+  empty.Reset("");
+  EXPECT_EQ(SHA1Digest(string("\x01", 1) +
+                       string(reinterpret_cast<const char*>(
+                           SHA1Digest(string("\0", 1)).digest()),
+                              SHA1Digest::LENGTH)).hexdigest(),
+            empty.hexdigest());
+}
+
+TEST(TreeHashDigestTest, StreamingMatchesReset) {
+  ThreadPool pool(4);
+  for (size_t size : {0, 1, 999, 1000, 1001, 10003}) {
+    const string input = MakeInput(size);
+    TreeHashDigest<MD5Digest> oneshot(1000, &pool);
+    oneshot.Reset(input);
+
+    for (size_t chunk : {1, 7, 1000, 4096}) {
+      TreeHashDigest<MD5Digest> streaming(1000, &pool);
+      streaming.Init();
+      for (size_t offset = 0; offset < size; offset += chunk) {
+        streaming.Update(input.data() + offset,
+                         std::min(chunk, size - offset));
+      }
+      streaming.Final();
+      EXPECT_EQ(oneshot, streaming) << "size: " << size
+                                    << " chunk: " << chunk;
+    }
+  }
+}
+
+TEST(TreeHashDigestTest, RootDependsOnLeafSize) {
+  const string input = MakeInput(5000);
+  TreeHashDigest<SHA1Digest> small(1000);
+  TreeHashDigest<SHA1Digest> large(4096);
+  small.Reset(input);
+  large.Reset(input);
+  EXPECT_FALSE(small == large);
+}
+
+}  // namespace vobla